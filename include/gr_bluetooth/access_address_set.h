@@ -0,0 +1,87 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_GR_BLUETOOTH_ACCESS_ADDRESS_SET_H
+#define INCLUDED_GR_BLUETOOTH_ACCESS_ADDRESS_SET_H
+
+#include <gr_bluetooth/api.h>
+#include <stdint.h>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*!
+     * \brief The access addresses of live LE connections.
+     *
+     * An open addressing hash set, so that le_packet::sniff_aa() can
+     * test the 32 bits at each offset against every connection with
+     * one probe, however many there are.  0 marks an empty slot; it is
+     * never a valid access address.  The table is kept at most half
+     * full.
+     */
+    class GR_BLUETOOTH_API access_address_set
+    {
+    private:
+      std::vector<uint32_t> d_slots;
+      int                   d_size;
+      int                   d_shift;
+
+      /* first slot to probe for aa */
+      unsigned slot(uint32_t aa) const
+      {
+        return (aa * 0x9e3779b1u) >> d_shift;
+      }
+
+      void rehash(int slots);
+
+    public:
+      access_address_set();
+
+      int size() const { return d_size; }
+      bool empty() const { return d_size == 0; }
+
+      /* add aa, returns false if it was already there */
+      bool insert(uint32_t aa);
+
+      /* remove aa, returns false if it wasn't there */
+      bool erase(uint32_t aa);
+
+      bool contains(uint32_t aa) const
+      {
+        unsigned mask = d_slots.size() - 1;
+        for (unsigned i = slot(aa); d_slots[i]; i = (i + 1) & mask) {
+          if (d_slots[i] == aa) {
+            return true;
+          }
+        }
+        return false;
+      }
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_GR_BLUETOOTH_ACCESS_ADDRESS_SET_H */
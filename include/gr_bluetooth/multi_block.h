@@ -26,13 +26,19 @@
 #define INCLUDED_GR_BLUETOOTH_MULTI_BLOCK_H
 
 #include <gr_bluetooth/api.h>
+#include <gr_bluetooth/symbol_buffer.h>
 #include <gnuradio/sync_block.h>
 #include <gnuradio/filter/mmse_fir_interpolator_ff.h>
 #include <gnuradio/filter/freq_xlating_fir_filter.h>
+#include <boost/function.hpp>
 
 namespace gr {
   namespace bluetooth {
 
+    class channelizer;
+    class worker_pool;
+    class band_scan;
+
     /*!
      * \brief Bluetooth multi-channel parent class.
      * \ingroup bluetooth
@@ -40,8 +46,10 @@ namespace gr {
     class  GR_BLUETOOTH_API multi_block : virtual public gr::sync_block
     {
     protected:
-      multi_block() {} // to allow for pure virtual
+      multi_block() : d_channelizer(NULL), d_interp(NULL), d_workers(NULL), d_band_scan(NULL),
+                      d_stream_list(NULL), d_channel_in(NULL), d_channel_fn(NULL) {} // to allow for pure virtual
       multi_block(double sample_rate, double center_freq, double squelch_threshold);
+      ~multi_block();
 
       /* symbols per second */
       static const int SYMBOL_RATE = 1000000;
@@ -85,12 +93,33 @@ namespace gr {
 
       /* mm_cr variables */
       float d_gain_mu;		// gain for adjusting mu
-      float d_mu;				// fractional sample position [0.0, 1.0]
+      float d_mu;				// initial fractional sample position [0.0, 1.0]
       float d_omega_relative_limit;	// used to compute min and max omega
       float d_omega;			// nominal frequency
       float d_gain_omega;		// gain for adjusting omega
       float d_omega_mid;		// average omega
-      float d_last_sample;
+
+      /* M&M clock recovery state of a single channel */
+      struct clock_recovery {
+        float    mu;			// fractional sample position
+        float    omega;			// current samples per symbol estimate
+        float    last_sample;
+        uint64_t origin;		// raw sample index mu is relative to, if valid
+        bool     have_origin;
+
+        /* interpolator filters keep scratch state, so each channel has its own */
+        gr::filter::mmse_fir_interpolator_ff *interp;
+      };
+
+      /* symbols the clock may free-run between windows before timing is dropped */
+      static const int MAX_CLOCK_RECOVERY_GAP = 2 * SYMBOLS_PER_BASIC_RATE_SLOT;
+
+      /*
+       * Clock recovery state indexed by classic channel, carried across
+       * calls to work() so that each channel's timing loop converges
+       * once instead of re-acquiring every slot.
+       */
+      std::vector<clock_recovery> d_clock_recovery;
 
       /* target SNR */
       double d_target_snr;
@@ -100,6 +129,89 @@ namespace gr {
       std::vector<float> d_channel_filter;
       std::map<int, gr::filter::freq_xlating_fir_filter_ccf::sptr> d_channel_ddcs;
 
+      /*
+       * polyphase channelizer producing every channel in one pass, used
+       * instead of d_channel_ddcs when the input is on the channel raster
+       */
+      channelizer *d_channelizer;
+      std::map<int, int> d_channel_bins;
+
+      /* value of d_cumulative_count when d_channelizer last ran */
+      uint64_t d_channelized_count;
+
+      /*
+       * Streaming symbol recovery: rather than re-filtering the whole
+       * history every slot, each channel keeps its own demodulator and
+       * clock recovery state plus a window of sliced symbols, and only
+       * the samples that are new since the previous slot are processed.
+       * Channels the band scan finds idle are not advanced at all; when
+       * they come back their stream starts over.
+       */
+      struct channel_stream {
+        /* d_channelizer output bin carrying this channel */
+        int                bin;
+
+        /* absolute channelizer output the stream goes on from */
+        uint64_t           next_output;
+
+        /* last channel sample, needed to demodulate the next one */
+        gr_complex         last_sample;
+        bool               have_last_sample;
+
+        /* demodulated samples not yet consumed by clock recovery */
+        std::vector<float> demod;
+
+        /* sliced symbols, the current window starts at head */
+        symbol_buffer      symbols;
+        int                head;
+
+        /* channel power and sample count of the most recent slots */
+        std::vector<double> slot_energy;
+        std::vector<int>    slot_count;
+        int                 slot_index;
+      };
+
+      /* stream channels from d_channelizer instead of re-filtering */
+      bool d_streaming;
+      std::map<int, channel_stream> d_streams;
+
+      /* absolute index of the next channelizer output to produce */
+      uint64_t d_stream_next_output;
+
+      /* absolute index of the first channelizer output of this slot */
+      uint64_t d_stream_first_output;
+
+      /* value of d_cumulative_count when the streams were last advanced */
+      uint64_t d_streamed_count;
+
+      /* number of symbols kept in each channel's window */
+      int d_stream_symbols;
+
+      /*
+       * Scratch space for one channel's trip through the sample path,
+       * sized when history() is set so that work() never allocates.
+       */
+      struct channel_scratch {
+        std::vector<gr_complex>   samples;
+        symbol_buffer             symbols;
+        std::vector<gr_complex>   demod_in;
+        std::vector<float>        demod_out;
+        std::vector<float>        cr_out;
+        std::vector<gr_complex>   noise;
+
+        /* single entry port vectors for calling DDC work() */
+        gr_vector_const_void_star ddc_in;
+        gr_vector_void_star       ddc_out;
+        gr_vector_const_void_star sample_in;
+        gr_vector_void_star       sample_out;
+
+        /* times one of the buffers above had to grow after set-up */
+        unsigned long             growths;
+      };
+
+      /* indexed like for_each_channel(), from d_low_freq */
+      std::vector<channel_scratch> d_scratch;
+
       /* noise power filter coefficients */
       double d_noise_filter_width;
       std::vector<float> d_noise_filter;
@@ -115,18 +227,71 @@ namespace gr {
       /* interpolator M&M clock recovery block */
       gr::filter::mmse_fir_interpolator_ff *d_interp;
 
-      /* M&M clock recovery, adapted from gr_clock_recovery_mm_ff */
-      int mm_cr(const float *in, int ninput_items, float *out, int noutput_items);
+      /* threads that process channels in parallel, see for_each_channel() */
+      worker_pool *d_workers;
+
+      /* coarse wideband power scan deciding which channels get filtered */
+      band_scan *d_band_scan;
+
+      /* dB over the band's floor a channel needs to pass the scan, 0 or less for off */
+      double d_band_scan_threshold;
+
+      /* indices (from d_low_freq) of channels the last scan found active */
+      std::vector<int> d_active_channels;
+
+      /* value of d_cumulative_count when scan_band() last ran */
+      uint64_t d_scanned_count;
+
+      /*
+       * slots since the band scan last passed each channel; a channel
+       * stays active while anything it sent is still in the window
+       */
+      std::vector<int> d_idle_slots;
+
+      /* d_channelizer bin of each channel, for scanning its power */
+      std::vector<int> d_scan_bins;
+
+      /* indices (from d_low_freq) of every channel d_channelizer streams */
+      std::vector<int> d_stream_channels;
+
+      /* channels stream_channel() is advancing in this slot */
+      const std::vector<int> *d_stream_list;
+
+      /* per channel work of for_each_channel(), with the slot's input */
+      typedef boost::function<void (gr_vector_const_void_star&, int, double)> channel_fn;
+      gr_vector_const_void_star *d_channel_in;
+      const channel_fn          *d_channel_fn;
+
+      /* channelizer outputs stream_channel() takes in this slot */
+      int d_stream_noutput_items;
+
+      /*
+       * parallel_for() bodies, bound once here rather than every slot
+       * since building a boost::function from a bind allocates
+       */
+      boost::function<void (int)> d_channel_task;
+      boost::function<void (int)> d_stream_task;
+
+      /*
+       * M&M clock recovery, adapted from gr_clock_recovery_mm_ff.  Runs
+       * with and updates the state in cr; a mu beyond 1.0 skips input.
+       */
+      int mm_cr(clock_recovery& cr, const float *in, int ninput_items,
+                float *out, int noutput_items, int *ninput_consumed = NULL);
+
+      /* clock recovery state for a channel, created on first use */
+      clock_recovery& channel_clock_recovery(int channel);
 
       /* fm demodulation, taken from gr_quadrature_demod_cf */
       void demod(const gr_complex *in, float *out, int noutput_items);
 
-      /* binary slicer, similar to gr_binary_slicer_fb */
-      void slicer(const float *in, char *out, int noutput_items);
+      /* binary slicer, similar to gr_binary_slicer_fb, appending to out */
+      void slicer(const float *in, symbol_buffer& out, int noutput_items);
 
       /**
        * Extract a single BT channel's worth of samples from the wider
-       * bandwidth samples.
+       * bandwidth samples.  When streaming, out is left untouched and
+       * the size of the channel's symbol window is returned.
        */
       int channel_samples( const double               freq,
                            gr_vector_const_void_star& in, 
@@ -136,10 +301,13 @@ namespace gr {
 
       /**
        * Produce symbols stream for a single BT channel, developed
-       * from of the raw samples for a single BT channel.
+       * from of the raw samples for a single BT channel.  When
+       * streaming, the channel's symbol window is copied out instead.
+       * out is replaced and its size returned.
        */
-      int channel_symbols( gr_vector_const_void_star &in, 
-                           char *out, 
+      int channel_symbols( const double               freq,
+                           gr_vector_const_void_star &in, 
+                           symbol_buffer&             out, 
                            int ninput_items );
 
       bool check_snr( const double               freq, 
@@ -153,6 +321,76 @@ namespace gr {
       /* set available channels based on d_center_freq and d_sample_rate */
       void set_channels();
 
+      /*
+       * Run the channelizer over this time slot's input, once per slot.
+       * When streaming, only the input that is new since the last slot.
+       */
+      void channelize(gr_vector_const_void_star& in, int ninput_items);
+
+      /*
+       * Advance the streams of the channels the band scan found active
+       * in this slot, or of every channel if there was no scan.
+       */
+      void stream_channels(gr_vector_const_void_star& in, int ninput_items);
+
+      /* demodulate, clock recover and slice new samples for one channel */
+      void stream_symbols(int channel, channel_stream& st, channel_scratch& sc,
+                          const gr_complex *samples, int nsamples);
+
+      /* stream_channels() work for the index'th streamed channel */
+      void stream_channel(int index);
+
+      /*
+       * Start a stream over after its input skipped ahead.  Symbol timing
+       * free-runs over a short gap, as in channel_symbols().
+       */
+      void restart_stream(int channel, channel_stream& st);
+
+      /* number of classic channels between d_low_freq and d_high_freq */
+      int num_channels();
+
+      /* size every channel's scratch space for the current history() */
+      void size_scratch();
+
+      /* scratch space of the channel at freq, which must be in range */
+      channel_scratch& scratch(double freq);
+
+      /* buffers big enough for any channel_samples() or channel_symbols() output */
+      gr_complex *scratch_samples(int index);
+      symbol_buffer& scratch_symbols(int index);
+
+      /* buf with room for n items; growing it here is counted */
+      template <typename T>
+      T *scratch_buffer(channel_scratch& sc, std::vector<T>& buf, size_t n)
+      {
+        if (buf.size() < n) {
+          buf.resize(n);
+          sc.growths++;
+        }
+        return &buf[0];
+      }
+
+      /*
+       * Call fn(in, index, freq) for every active channel from d_low_freq
+       * to d_high_freq, in parallel.  The shared channelizer and the band
+       * scan run first; channels the scan finds idle are skipped (and not
+       * streamed), so per-channel results must be reset before calling
+       * this.  A channel stays active for as many slots as the window
+       * spans after the scan last heard it.  fn may
+       * call channel_samples(), check_snr() and channel_symbols() but
+       * must otherwise touch only state that belongs to its channel.
+       * Work that needs to see channels in order (piconet state,
+       * printing) belongs after this returns.  fn is best bound once,
+       * in the constructor, so that work() doesn't allocate.
+       */
+      void for_each_channel(gr_vector_const_void_star& in, int ninput_items,
+                            const channel_fn& fn);
+
+      void channel_task(int active);
+
+      /* run the band scan over this slot's new input and work out the active channels */
+      void scan_band(gr_vector_const_void_star& in, int ninput_items);
+
       /* returns relative (with respect to d_center_freq) frequency in Hz of given channel */
       double channel_rel_freq(int channel);
 
@@ -161,6 +399,22 @@ namespace gr {
       int abs_freq_channel(double freq);
 
     public:
+      /*
+       * Number of times a scratch buffer or channel stream had to be
+       * grown on the sample path after set-up.  This only covers those
+       * buffers; it is not a count of every allocation work() makes.
+       */
+      unsigned long scratch_growths() const;
+
+      /*
+       * dB a channel's loudest band scan segment must stand above the
+       * band's floor before the channel is filtered at all.  Starts at
+       * the squelch threshold, capped at 3 dB.  Zero or less turns the
+       * band scan off, so that every channel goes to check_snr().
+       */
+      void set_band_scan_threshold(double threshold);
+      double band_scan_threshold() const;
+
       virtual int work (int noutput_items,
                         gr_vector_const_void_star &input_items,
                         gr_vector_void_star &output_items) = 0;
@@ -29,6 +29,7 @@
 
 #include <gr_bluetooth/api.h>
 #include <gnuradio/sync_block.h>
+#include <gr_bluetooth/piconet.h>
 
 namespace gr {
 namespace bluetooth {
@@ -50,8 +51,14 @@ namespace bluetooth {
              * constructor is in a private implementation
              * class. gr::bluetooth::no_filter_sniffer::make is the public interface for
              * creating new instances.
+             *
+             * Each piconet found holds at most \p queue_size packets awaiting
+             * decode, and drops those older than \p queue_age CLKN ticks (0
+             * keeps them until the queue overflows).
              */
-            static sptr make(double sample_rate, double center_freq);
+            static sptr make(double sample_rate, double center_freq,
+                             int queue_size = piconet::DEFAULT_QUEUE_SIZE,
+                             int queue_age = piconet::DEFAULT_QUEUE_AGE);
     };
 
 } // namespace bluetooth
@@ -28,8 +28,11 @@
 #define INCLUDED_GR_BLUETOOTH_PACKET_H
 
 #include <gr_bluetooth/api.h>
+#include <gr_bluetooth/symbol_buffer.h>
+#include <gr_bluetooth/access_address_set.h>
 #include <gnuradio/sync_block.h>
 #include <string>
+#include <vector>
 
 namespace gr {
   namespace bluetooth {
@@ -58,10 +61,8 @@ namespace gr {
 
       static const int MAX_SYMBOLS = 3125;       /* maximum number of symbols */
 
-      /* the raw symbol stream, one bit per char */
-      //FIXME maybe this should be a vector so we can grow it only to the size
-      //needed and later shrink it if we find we have more symbols than necessary
-      char d_symbols[MAX_SYMBOLS];
+      /* the raw symbol stream, packed, no longer than MAX_SYMBOLS */
+      symbol_buffer d_symbols;
       
       /* packet type */
       int d_packet_type;
@@ -77,11 +78,14 @@ namespace gr {
 
       /* The actual payload data in host format
        * Ready for passing to wireshark
-       * 2744 is the maximum length, but most packets are shorter.
-       * Dynamic allocation would probably be better in the long run but is
-       * problematic in the short run.
+       * 2744 is the maximum length, but most packets are much shorter, so
+       * it only grows as far as the payload decoded so far, see
+       * payload_bits().
        */
-      char d_payload[2744];
+      std::vector<char> d_payload;
+
+      /* d_payload with room for at least bits bits, zero filled */
+      char *payload_bits(int bits);
       
       /* is the packet whitened? */
       bool d_whitened;
@@ -92,15 +96,20 @@ namespace gr {
       // -------------------------------------------------------------------
 
       packet() {}
-      packet(char *stream, int length, double freq=0.0);
+      packet(const symbol_buffer& stream, int offset, int length, double freq=0.0);
       virtual ~packet( ) {}
 
+      /* start over as a new packet, as the constructor would, keeping buffers */
+      void reset(const symbol_buffer& stream, int offset, int length, double freq=0.0);
+
       // -------------------------------------------------------------------
 
       /* whitening data, both classic and LE use the same whitening LFSR */
       static const uint8_t WHITENING_DATA[127];
 
       static int sniff_packet(char *stream, int stream_length, double freq, air_format& fmt);
+      static int sniff_packet(const symbol_buffer& stream, int offset, int stream_length,
+                              double freq, air_format& fmt);
 
       /* Reverse the bits in a byte */
       static uint8_t reverse(char byte);
@@ -181,6 +190,14 @@ namespace gr {
       /* construct with known CLKN and channel */
       static sptr make(char *stream, int length, uint32_t clkn, double freq);
 
+      /* the same, from length symbols of a packed stream starting at offset */
+      static sptr make(const symbol_buffer& stream, int offset, int length);
+      static sptr make(const symbol_buffer& stream, int offset, int length,
+                       uint32_t clkn, double freq);
+
+      /* classic channel of freq in Hz, -1 if out of band */
+      static int freq2chan(const double freq);
+
       /* minimum header bit errors to indicate that this is an ID packet */
       static const int ID_THRESHOLD = 5;
 
@@ -204,30 +221,55 @@ namespace gr {
       /* search a symbol stream to find a packet, return index */
       static int sniff_ac(char *stream, int stream_length);
 
+      /* search stream_length positions from offset, return index relative to offset */
+      static int sniff_ac(const symbol_buffer& stream, int offset, int stream_length);
+
       /* Error correction coding for Access Code */
       static uint8_t *lfsr(uint8_t *data, int length, int k, uint8_t *g);
 
       /* Generate Access Code from an LAP */
       static uint8_t *acgen(int LAP);
+      static void acgen(int LAP, uint8_t *ac);
 
       /* Decode 1/3 rate FEC, three like symbols in a row */
       static bool unfec13(char *input, char *output, int length);
+      static bool unfec13(const symbol_buffer& input, int offset, char *output, int length);
 
       /* Decode 2/3 rate FEC, a (15,10) shortened Hamming code */
       static char *unfec23(char *input, int length);
+      static char *unfec23(const symbol_buffer& input, int offset, int length);
+
+      /* whole payload into output, which holds length rounded up to 10 */
+      static bool unfec23(const symbol_buffer& input, int offset, char *output, int length);
+
+      /* one packed 15 symbol block, returns the 10 data bits or -1 */
+      static int unfec23_block(uint32_t block);
 
       /* When passed 10 bits of data this returns a pointer to a 5 bit hamming code */
       //static char *fec23gen(char *data);
 
       /* Create an Access Code from LAP and check it against stream */
       static bool check_ac(char *stream, int LAP);
+      static bool check_ac(const symbol_buffer& stream, int offset, int LAP);
 
       /* Create the 16bit CRC for classic packet payloads - input air order stream */
       static uint16_t crcgen(char *payload, int length, int UAP);
 
+      /*
+       * What unwhitening length bits (data then 16 bit CRC) with clock
+       * from skip does to crcgen() of the data XOR the CRC field
+       */
+      static uint16_t whitening_crc(int clock, int skip, int length);
+
       /* extract UAP by reversing the HEC computation */
       static int UAP_from_hec(uint16_t data, uint8_t hec);
 
+      /* UAP_from_hec() one bit at a time, the reference its tables come from */
+      static int UAP_from_hec_bits(uint16_t data, uint8_t hec);
+
+      /* header_present() of length symbols of stream from offset */
+      static bool header_present(const symbol_buffer& stream, int offset, int length);
+
       /* check if the classic_packet's CRC is correct for a given clock (CLK1-6) */
       virtual int crc_check(int clock) = 0;
 
@@ -266,6 +308,16 @@ namespace gr {
        */
       virtual uint8_t try_clock(int clock) = 0;
 
+      /*
+       * try_clock() and then crc_check() for every clock (CLK1-6) set in
+       * clocks, decoding the header and payload FEC only once.  The CRC
+       * is checked where want_UAP[clock] is negative or matches the UAP
+       * found.  Fills UAPs[clock] and results[clock], the latter -1
+       * when the UAP didn't match.
+       */
+      virtual void check_clocks(uint64_t clocks, const int *want_UAP,
+                                uint8_t *UAPs, int *results) = 0;
+
       /* check to see if the classic packet has a header */
       virtual bool header_present() = 0;
 
@@ -284,12 +336,48 @@ namespace gr {
       int get_channel( ) { return d_channel; }
     };
 
+    /*!
+     * \brief A classic packet still in the symbols it was found in.
+     *
+     * Looks at the access code and header in place, so that the many
+     * hits that turn out to be ID packets or noise are dropped without
+     * copying any symbols.  make() gives an owning classic_packet for
+     * the ones worth keeping.  The stream must outlive the view.
+     */
+    class GR_BLUETOOTH_API classic_packet_view
+    {
+    private:
+      const symbol_buffer& d_stream;
+      int                  d_offset;
+      int                  d_length;
+      double               d_freq;
+
+    public:
+      classic_packet_view(const symbol_buffer& stream, int offset, int length,
+                          double freq=0.0);
+
+      /* LAP found in the access code */
+      uint32_t get_LAP() const;
+
+      int get_channel() const;
+
+      /* check to see if the packet has a header */
+      bool header_present() const;
+
+      /* copy the packet out, as classic_packet::make() */
+      classic_packet::sptr make(uint32_t clkn) const;
+    };
+
 #define LE_MAX_PDU_OCTETS 39
 #define LE_MAX_OCTETS     (1+4+LE_MAX_PDU_OCTETS+3)
 #define LE_MAX_SYMBOLS    (8*LE_MAX_OCTETS)
 
     class GR_BLUETOOTH_API le_packet : virtual public packet
     {
+    private:
+      static int find_aa(const symbol_buffer& stream, int offset, int stream_length, double freq,
+                         const access_address_set *aas);
+
     public:
       static const unsigned MAX_PDU_OCTETS = LE_MAX_PDU_OCTETS;
       static const unsigned MAX_OCTETS     = LE_MAX_OCTETS;
@@ -298,6 +386,7 @@ namespace gr {
       typedef boost::shared_ptr<le_packet> sptr;
 
       static sptr make(char *stream, int length, double freq=0.0);
+      static sptr make(const symbol_buffer& stream, int offset, int length, double freq=0.0);
       static int freq2chan(const double freq);
       static int chan2index(const int chan);
       static int freq2index(const double freq);
@@ -321,6 +410,35 @@ namespace gr {
       static const uint8_t DATA_HEADER_DISTANCE_MSB[256];
 
       static int sniff_aa(char *stream, int stream_length, double freq);
+      static int sniff_aa(const symbol_buffer& stream, int offset, int stream_length, double freq);
+
+      /*
+       * the same, but on data channels only accepting the connection
+       * AAs in aas, found with one lookup per offset
+       */
+      static int sniff_aa(const symbol_buffer& stream, int offset, int stream_length, double freq,
+                          const access_address_set& aas);
+
+      /* CRCInit of every advertising channel packet */
+      static const uint32_t ADVERTISING_CRC_INIT = 0x555555;
+
+      /* CRC24 of length bytes of PDU, from crc_init as CONNECT_REQ gives it */
+      static uint32_t crcgen(const uint8_t *data, int length, uint32_t crc_init);
+
+      /* is this an advertising channel packet? */
+      virtual bool is_advertising() = 0;
+
+      /* set the CRCInit a data channel packet's CRC is checked against */
+      virtual void set_crc_init(uint32_t crc_init) = 0;
+
+      /*
+       * for a CONNECT_REQ that passed its CRC, the AA and CRCInit of the
+       * connection it sets up
+       */
+      virtual bool connect_req(uint32_t& aa, uint32_t& crc_init) = 0;
+
+      /* is this an LL_TERMINATE_IND that passed its CRC? */
+      virtual bool terminate_ind() = 0;
 
       /* decode the packet header */
       virtual bool decode_header() = 0;
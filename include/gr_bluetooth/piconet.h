@@ -29,6 +29,7 @@
 
 #include <gr_bluetooth/api.h>
 #include "gr_bluetooth/packet.h"
+#include <vector>
 
 namespace gr {
   namespace bluetooth {
@@ -39,12 +40,36 @@ namespace gr {
       friend class base_rate_piconet;
       friend class low_energy_piconet;
 
-      /* queue of packets to be decoded */
+      /*
+       * queue of packets to be decoded, a ring of d_pkt_queue.size()
+       * entries holding d_queue_count packets from d_queue_head on,
+       * each enqueued at the matching d_queue_times entry
+       */
       std::vector<packet::sptr> d_pkt_queue;
+      std::vector<uint32_t>     d_queue_times;
+      int                       d_queue_head;
+      int                       d_queue_count;
+
+      /* queue budget, see set_queue_limits() */
+      uint32_t                  d_queue_max_age;
+
+      /* packets dropped for lack of room or for waiting too long */
+      unsigned long             d_queue_overflows;
+      unsigned long             d_queue_expired;
+
+      /* drop the packet at the head of the queue */
+      void drop_head();
+
+    protected:
+      piconet();
 
     public:
       typedef boost::shared_ptr<piconet> sptr;
 
+      /* default queue budget: 256 packets, 10 s of CLKN (625 us ticks) */
+      static const int      DEFAULT_QUEUE_SIZE = 256;
+      static const uint32_t DEFAULT_QUEUE_AGE  = 16000;
+
       /* initialize the hop reversal process */
       /* returns number of initial candidates for CLK1-27 */
       virtual int init_hop_reversal(bool aliased) = 0;
@@ -58,11 +83,28 @@ namespace gr {
       /* reset UAP/clock discovery */
       virtual void reset() = 0;
 
-      /* add a packet to the queue */
-      void enqueue(packet::sptr pkt);
+      /*
+       * add a packet to the queue at CLKN time, dropping the oldest
+       * packets to stay within the queue budget
+       */
+      void enqueue(packet::sptr pkt, uint32_t time = 0);
 
       /* pull the first packet from the queue (FIFO) */
       packet::sptr dequeue();
+
+      /*
+       * Hold at most size packets, none enqueued more than max_age CLKN
+       * ticks before the latest (0 for no age limit).  Packets that no
+       * longer fit are dropped, oldest first.
+       */
+      void set_queue_limits(int size, uint32_t max_age);
+
+      /* number of packets waiting in the queue */
+      int queue_length() const { return d_queue_count; }
+
+      /* packets dropped because the queue was full or they were too old */
+      unsigned long queue_overflows() const { return d_queue_overflows; }
+      unsigned long queue_expired() const { return d_queue_expired; }
     };
 
     class GR_BLUETOOTH_API basic_rate_piconet : public piconet {
@@ -139,6 +181,11 @@ namespace gr {
        */
       static sptr make(const uint32_t aa);
 
+      /* CRCInit of the connection, from its CONNECT_REQ */
+      virtual uint32_t get_crc_init() = 0;
+      virtual void set_crc_init(uint32_t crc_init) = 0;
+      virtual bool have_crc_init() = 0;
+
       // -------------------------------------------------------------------
 
       /* initialize the hop reversal process */
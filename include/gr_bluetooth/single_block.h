@@ -30,6 +30,7 @@
 #include <gnuradio/filter/mmse_fir_interpolator_ff.h>
 #include <gnuradio/sync_block.h>
 #include <gr_bluetooth/api.h>
+#include <gr_bluetooth/symbol_buffer.h>
 
 namespace gr {
 namespace bluetooth {
@@ -120,8 +121,8 @@ protected:
     /* fm demodulation, taken from gr_quadrature_demod_cf */
     void demod(const gr_complex* in, float* out, int noutput_items);
 
-    /* binary slicer, similar to gr_binary_slicer_fb */
-    void slicer(const float* in, char* out, int noutput_items);
+    /* binary slicer, similar to gr_binary_slicer_fb, appending to out */
+    void slicer(const float* in, symbol_buffer& out, int noutput_items);
 
     /**
      * Extract a single BT channel's worth of samples from the wider
@@ -134,9 +135,10 @@ protected:
 
     /**
      * Produce symbols stream for a single BT channel, developed
-     * from of the raw samples for a single BT channel.
+     * from of the raw samples for a single BT channel.  out is
+     * replaced and its size returned.
      */
-    int channel_symbols(gr_vector_const_void_star& in, char* out, int ninput_items);
+    int channel_symbols(gr_vector_const_void_star& in, symbol_buffer& out, int ninput_items);
 
     bool
     check_snr(const double on_channel_energy, double& snr, gr_vector_const_void_star& in);
@@ -28,6 +28,7 @@
 #define INCLUDED_GR_BLUETOOTH_SINGLE_MULTI_SNIFFER_H
 
 #include <gr_bluetooth/api.h>
+#include <gr_bluetooth/piconet.h>
 #include <gr_bluetooth/single_block.h>
 
 namespace gr {
@@ -51,9 +52,17 @@ public:
      * constructor is in a private implementation
      * class. gr::bluetooth::single_multi_sniffer::make is the public interface for
      * creating new instances.
+     *
+     * Each piconet found holds at most \p queue_size packets awaiting
+     * decode, and drops those older than \p queue_age CLKN ticks (0
+     * keeps them until the queue overflows).
      */
-    static sptr
-    make(double sample_rate, double center_freq, double squelch_threshold, bool tun);
+    static sptr make(double sample_rate,
+                     double center_freq,
+                     double squelch_threshold,
+                     bool tun,
+                     int queue_size = piconet::DEFAULT_QUEUE_SIZE,
+                     int queue_age = piconet::DEFAULT_QUEUE_AGE);
 };
 
 } // namespace bluetooth
@@ -0,0 +1,128 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_GR_BLUETOOTH_SYMBOL_BUFFER_H
+#define INCLUDED_GR_BLUETOOTH_SYMBOL_BUFFER_H
+
+#include <gr_bluetooth/api.h>
+#include <stdint.h>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*!
+     * \brief A stream of demodulated symbols, packed 64 to a word.
+     *
+     * Symbol i is bit i % 64 of word i / 64, so reading n symbols from
+     * pos with bits() gives the same value as air_to_host*() gives for
+     * the one-symbol-per-char representation.  Bits past size() are
+     * always zero and one spare zero word follows the last symbol,
+     * which lets bits() read two words without checking the length.
+     */
+    class GR_BLUETOOTH_API symbol_buffer
+    {
+    private:
+      std::vector<uint64_t> d_words;
+      int                   d_size;
+
+      /* append the low n (<= 64) bits of v */
+      void append_bits(uint64_t v, int n);
+
+      /* zero everything past d_size */
+      void trim();
+
+    public:
+      static const int SYMBOLS_PER_WORD = 64;
+
+      symbol_buffer();
+      explicit symbol_buffer(int size);
+
+      /* pack one symbol per char, as byte streams and libbtbb carry them */
+      symbol_buffer(const char *symbols, int size);
+
+      int size() const { return d_size; }
+      bool empty() const { return d_size == 0; }
+
+      /* number of symbols that fit without reallocating */
+      int capacity() const;
+      void reserve(int size);
+
+      /* symbols added by growing are 0 */
+      void resize(int size);
+      void clear() { resize(0); }
+
+      /* packed storage, (size() + 63) / 64 words of it in use */
+      uint64_t *words() { return &d_words[0]; }
+      const uint64_t *words() const { return &d_words[0]; }
+
+      int operator[](int i) const
+      {
+        return (int) ((d_words[i >> 6] >> (i & 63)) & 1);
+      }
+
+      void set(int i, int symbol);
+
+      /* n (<= 64) symbols starting at pos < size(), the first in the LSB */
+      uint64_t bits(int pos, int n) const
+      {
+        int word = pos >> 6;
+        int shift = pos & 63;
+        uint64_t v = d_words[word] >> shift;
+        if (shift) {
+          v |= d_words[word + 1] << (64 - shift);
+        }
+        return (n < 64) ? (v & ((UINT64_C(1) << n) - 1)) : v;
+      }
+
+      /* Hamming distance between n symbols at pos and the low n bits of pattern */
+      int distance(int pos, uint64_t pattern, int n) const
+      {
+        return __builtin_popcountll(bits(pos, n) ^ pattern);
+      }
+
+      /* append n packed symbols, the first in the LSB of words[0] */
+      void append(const uint64_t *words, int n);
+
+      /* append n symbols of src starting at pos */
+      void append(const symbol_buffer& src, int pos, int n);
+
+      /* replace the contents with n symbols of src starting at pos */
+      void assign(const symbol_buffer& src, int pos, int n);
+
+      /* drop the first n symbols */
+      void erase_front(int n);
+
+      /* replace the contents with n symbols, one per char */
+      void pack(const char *symbols, int n);
+
+      /* n symbols from pos, one per char */
+      void unpack(int pos, int n, char *out) const;
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_GR_BLUETOOTH_SYMBOL_BUFFER_H */
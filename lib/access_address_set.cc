@@ -0,0 +1,114 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gr_bluetooth/access_address_set.h"
+
+namespace gr {
+  namespace bluetooth {
+
+    /* smallest table, a power of two like every size */
+    static const int MIN_SLOTS = 64;
+
+    access_address_set::access_address_set()
+      : d_size(0)
+    {
+      rehash(MIN_SLOTS);
+    }
+
+    void access_address_set::rehash(int slots)
+    {
+      std::vector<uint32_t> old(slots, 0);
+      old.swap(d_slots);
+
+      d_shift = 32;
+      for (int count = slots; count > 1; count >>= 1) {
+        d_shift--;
+      }
+
+      d_size = 0;
+      for (unsigned i = 0; i < old.size(); i++) {
+        if (old[i]) {
+          insert(old[i]);
+        }
+      }
+    }
+
+    bool access_address_set::insert(uint32_t aa)
+    {
+      if (!aa || contains(aa)) {
+        return false;
+      }
+      if (2 * (d_size + 1) > (int) d_slots.size()) {
+        rehash(2 * d_slots.size());
+      }
+
+      unsigned mask = d_slots.size() - 1;
+      unsigned i = slot(aa);
+      while (d_slots[i]) {
+        i = (i + 1) & mask;
+      }
+      d_slots[i] = aa;
+      d_size++;
+      return true;
+    }
+
+    bool access_address_set::erase(uint32_t aa)
+    {
+      /* 0 marks an empty slot, so it is never a member */
+      if (!aa) {
+        return false;
+      }
+
+      unsigned mask = d_slots.size() - 1;
+      unsigned i = slot(aa);
+
+      while (d_slots[i] != aa) {
+        if (!d_slots[i]) {
+          return false;
+        }
+        i = (i + 1) & mask;
+      }
+
+      /* pull later entries of the probe run back over the gap */
+      unsigned gap = i;
+      for (i = (i + 1) & mask; d_slots[i]; i = (i + 1) & mask) {
+        unsigned home = slot(d_slots[i]);
+        /* move it if its home isn't cyclically within (gap, i] */
+        if (((i - home) & mask) >= ((i - gap) & mask)) {
+          d_slots[gap] = d_slots[i];
+          gap = i;
+        }
+      }
+      d_slots[gap] = 0;
+      d_size--;
+      return true;
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
@@ -0,0 +1,194 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "band_scan.h"
+#include <algorithm>
+#include <math.h>
+
+namespace gr {
+  namespace bluetooth {
+
+    /* FFT bin spacing to aim for, fine enough to see a 1 MHz channel's middle */
+    static const double BAND_SCAN_RESOLUTION = 62500.0;
+
+    /*
+     * consecutive segments averaged before looking for the peak: 4 x 16
+     * us is still shorter than the shortest (ID) packet, and the noise
+     * estimate steadies enough that idle channels rarely look busy
+     */
+    static const int BAND_SCAN_AVERAGE = 4;
+
+    /*
+     * dB the median may sit above the quietest tenth of segments before
+     * it is taken to be traffic rather than noise; on noise alone the
+     * two are about 1 dB apart
+     */
+    static const double BAND_SCAN_BUSY_SPREAD = 3.0;
+
+    band_scan::band_scan(double sample_rate, const std::vector<double> &rel_freqs,
+                         double bandwidth)
+      : d_fft_size(16),
+        d_fft(NULL),
+        d_peak(rel_freqs.size(), 0.0),
+        d_noise_floor(0.0),
+        d_quiet_floor(0.0)
+    {
+      while (d_fft_size < sample_rate / BAND_SCAN_RESOLUTION) {
+        d_fft_size *= 2;
+      }
+      d_fft = new gr::fft::fft_complex(d_fft_size, true);
+
+      d_window.resize(d_fft_size);
+      for (int i = 0; i < d_fft_size; i++) {
+        d_window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / d_fft_size);
+      }
+
+      double bin_width = sample_rate / d_fft_size;
+      for (unsigned c = 0; c < rel_freqs.size(); c++) {
+        int first = (int) ceil((rel_freqs[c] - bandwidth / 2) / bin_width);
+        int last  = (int) floor((rel_freqs[c] + bandwidth / 2) / bin_width) + 1;
+        d_first_bin.push_back(std::max(first, -d_fft_size / 2));
+        d_last_bin.push_back(std::min(last, d_fft_size / 2));
+      }
+    }
+
+    band_scan::~band_scan()
+    {
+      delete d_fft;
+    }
+
+    void
+    band_scan::scan(const gr_complex *in, int nsamples)
+    {
+      int nchannels = d_peak.size();
+      int nsegments = nsamples / d_fft_size;
+      gr_complex *fft_in = d_fft->get_inbuf();
+      const gr_complex *fft_out = d_fft->get_outbuf();
+
+      d_segment_power.resize(nsegments * nchannels);
+
+      for (int s = 0; s < nsegments; s++) {
+        const gr_complex *segment = &in[s * d_fft_size];
+        for (int i = 0; i < d_fft_size; i++) {
+          fft_in[i] = segment[i] * d_window[i];
+        }
+        d_fft->execute();
+
+        for (int c = 0; c < nchannels; c++) {
+          double power = 0.0;
+          for (int b = d_first_bin[c]; b < d_last_bin[c]; b++) {
+            /* negative frequencies live in the top half */
+            power += std::norm(fft_out[(b + d_fft_size) % d_fft_size]);
+          }
+          d_segment_power[s * nchannels + c] = power;
+        }
+      }
+
+      evaluate(nsegments);
+    }
+
+    void
+    band_scan::scan(const double *power, int nsegments, int stride,
+                    const std::vector<int> &columns)
+    {
+      int nchannels = d_peak.size();
+
+      d_segment_power.resize(nsegments * nchannels);
+      for (int s = 0; s < nsegments; s++) {
+        for (int c = 0; c < nchannels; c++) {
+          d_segment_power[s * nchannels + c] = power[s * stride + columns[c]];
+        }
+      }
+
+      evaluate(nsegments);
+    }
+
+    void
+    band_scan::evaluate(int nsegments)
+    {
+      int nchannels = d_peak.size();
+      std::fill(d_peak.begin(), d_peak.end(), 0.0);
+
+      /* peak of the running average, which also stands in for the segment */
+      int naverages = nsegments - BAND_SCAN_AVERAGE + 1;
+      if (naverages < 1) {
+        d_segment_power.clear();
+      }
+      for (int s = 0; s < naverages; s++) {
+        for (int c = 0; c < nchannels; c++) {
+          double power = 0.0;
+          for (int a = 0; a < BAND_SCAN_AVERAGE; a++) {
+            power += d_segment_power[(s + a) * nchannels + c];
+          }
+          d_segment_power[s * nchannels + c] = power;
+          d_peak[c] = std::max(d_peak[c], power);
+        }
+      }
+      if (naverages > 0) {
+        d_segment_power.resize(naverages * nchannels);
+      }
+
+      if (d_segment_power.empty()) {
+        d_noise_floor = 0.0;
+        d_quiet_floor = 0.0;
+        return;
+      }
+      std::vector<double>::iterator median = 
+        d_segment_power.begin() + d_segment_power.size() / 2;
+      std::nth_element(d_segment_power.begin(), median, d_segment_power.end());
+      d_noise_floor = *median;
+
+      /* everything below the median is now in front of it */
+      std::vector<double>::iterator quiet = 
+        d_segment_power.begin() + d_segment_power.size() / 10;
+      std::nth_element(d_segment_power.begin(), quiet, median);
+      d_quiet_floor = *quiet;
+    }
+
+    double
+    band_scan::peak_snr(int index) const
+    {
+      if (d_noise_floor <= 0.0) {
+        /* nothing to compare against, so don't rule the channel out */
+        return HUGE_VAL;
+      }
+      return 10.0 * log10(d_peak[index] / d_noise_floor);
+    }
+
+    bool
+    band_scan::conclusive() const
+    {
+      if ((d_noise_floor <= 0.0) || (d_quiet_floor <= 0.0)) {
+        return false;
+      }
+      return (10.0 * log10(d_noise_floor / d_quiet_floor)) <= BAND_SCAN_BUSY_SPREAD;
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
@@ -0,0 +1,105 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_BAND_SCAN_H
+#define INCLUDED_BLUETOOTH_BAND_SCAN_H
+
+#include <gnuradio/gr_complex.h>
+#include <gnuradio/fft/fft.h>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * Coarse look at the whole band before any channel is filtered.
+     * The input is cut into short FFT segments, and for every channel
+     * the power in the bins covering its middle is summed per segment.
+     * A channel counts as active when its loudest segment stands out
+     * from the typical (median) channel segment, which in a mostly idle
+     * band is the noise floor.  In a busy band the median is raised by
+     * traffic, which shows as a wide spread between the median and the
+     * quietest segments, and the scan is then inconclusive.  This costs
+     * a few small FFTs per slot, next to a full DDC for every channel,
+     * and nothing but the bookkeeping when a channelizer already has
+     * each channel's power per segment.
+     */
+    class band_scan
+    {
+    private:
+      int d_fft_size;
+      gr::fft::fft_complex *d_fft;
+      std::vector<float> d_window;
+
+      /* first and one past last FFT bin of each channel */
+      std::vector<int> d_first_bin;
+      std::vector<int> d_last_bin;
+
+      /* loudest segment of each channel in the last scan() */
+      std::vector<double> d_peak;
+
+      /* every channel's power in every segment, for the median */
+      std::vector<double> d_segment_power;
+      double d_noise_floor;
+
+      /* power of the quietest segments, to check the median against */
+      double d_quiet_floor;
+
+      /* peaks and floors from the nsegments in d_segment_power */
+      void evaluate(int nsegments);
+
+    public:
+      /*
+       * Channels are given by their offsets from the center frequency
+       * (Hz), and bandwidth is the part of each that is summed.
+       */
+      band_scan(double sample_rate, const std::vector<double> &rel_freqs,
+                double bandwidth);
+      ~band_scan();
+
+      /* measure every channel over nsamples of wideband input */
+      void scan(const gr_complex *in, int nsamples);
+
+      /*
+       * measure every channel from powers summed elsewhere: channel c
+       * has power[s * stride + columns[c]] in segment s
+       */
+      void scan(const double *power, int nsegments, int stride,
+                const std::vector<int> &columns);
+
+      /* wideband samples in one segment */
+      int segment_samples() const { return d_fft_size; }
+
+      /* loudest segment of channel index relative to the floor, in dB */
+      double peak_snr(int index) const;
+
+      /* false if the last scan() had no usable noise floor */
+      bool conclusive() const;
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_BAND_SCAN_H */
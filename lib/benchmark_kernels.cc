@@ -0,0 +1,105 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Throughput of the demodulator and slicer kernels against the scalar
+ * loops they replaced.  Not installed; build with
+ * -DENABLE_KERNEL_BENCHMARK=ON and run lib/benchmark_kernels [samples].
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "symbol_kernels.h"
+#include <gnuradio/math.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+
+using namespace gr::bluetooth;
+
+static const int BENCHMARK_PASSES = 200;
+
+static void
+scalar_demod(const gr_complex *in, float *out, int n, float gain)
+{
+  for (int i = 1; i < n; i++) {
+    gr_complex product = in[i] * conj(in[i-1]);
+    out[i] = gain * gr::fast_atan2f(imag(product), real(product));
+  }
+}
+
+/* time BENCHMARK_PASSES calls of fn and report samples/sec */
+template <typename F>
+static void
+report(const char *name, int n, F fn)
+{
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  for (int pass = 0; pass < BENCHMARK_PASSES; pass++) {
+    fn();
+  }
+  double seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+  printf("%-24s %10.1f Msamples/s\n", name, (double) n * BENCHMARK_PASSES / seconds / 1e6);
+}
+
+int
+main(int argc, char **argv)
+{
+  int n = (argc > 1) ? atoi(argv[1]) : (1 << 16);
+  if (n < 2) {
+    fprintf(stderr, "usage: %s [samples]\n", argv[0]);
+    return 1;
+  }
+
+  /* a GFSK-ish tone wandering about +/- 250 kHz at 2 samples/symbol */
+  std::vector<gr_complex> iq(n);
+  std::vector<float> soft(n);
+  double phase = 0;
+  srand(1);
+  for (int i = 0; i < n; i++) {
+    phase += ((rand() & 2) - 1) * M_PI_4;
+    iq[i] = gr_complex(cos(phase), sin(phase));
+    soft[i] = (float) rand() / RAND_MAX - 0.5f;
+  }
+  std::vector<float> demod_out(n);
+  std::vector<char> symbols(n);
+  std::vector<uint64_t> packed((n + 63) / 64);
+  float gain = 2 / M_PI_2;
+
+  printf("slicer variant: %s, %d samples x %d passes\n",
+         slicer_implementation(), n, BENCHMARK_PASSES);
+
+  report("demod scalar", n, [&]() { scalar_demod(&iq[0], &demod_out[0], n, gain); });
+  report("demod volk", n, [&]() { quadrature_demod(&iq[0], &demod_out[0], n, gain); });
+  report("slicer scalar", n, [&]() { binary_slicer_generic(&soft[0], &symbols[0], n); });
+  report("slicer bytes", n, [&]() { binary_slicer(&soft[0], &symbols[0], n); });
+  report("slicer packed scalar", n, [&]() { packed_slicer_generic(&soft[0], &packed[0], n); });
+  report("slicer packed", n, [&]() { packed_slicer(&soft[0], &packed[0], n); });
+
+  return 0;
+}
@@ -0,0 +1,151 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "channelizer.h"
+#include <math.h>
+#include <algorithm>
+
+namespace gr {
+  namespace bluetooth {
+
+    channelizer::channelizer(const std::vector<float> &taps, int nchannels)
+      : d_nchannels(nchannels),
+        d_decimation(nchannels / 2),
+        d_taps(taps),
+        d_fft(new gr::fft::fft_complex(nchannels, false)),
+        d_output(),
+        d_max_output(0),
+        d_noutput_items(0),
+        d_power(nchannels, 0.0),
+        d_segment(0),
+        d_segment_power(nchannels, 0.0)
+    {
+    }
+
+    channelizer::~channelizer()
+    {
+      delete d_fft;
+    }
+
+    int
+    channelizer::bin(double rel_freq, double sample_rate) const
+    {
+      int b = (int) lround(rel_freq * d_nchannels / sample_rate);
+      return ((b % d_nchannels) + d_nchannels) % d_nchannels;
+    }
+
+    /*
+     * For output o, with n = o * D + L - 1 the newest input sample under
+     * the filter, channel m is
+     *
+     *   y_m[o] = e^(-j2pi m o D / M) * sum_i h[i] x[n-i] e^(j2pi m i / M)
+     *
+     * Splitting i = p + kM makes the exponential depend on p alone, so
+     * the M polyphase branch sums feed a single M point inverse FFT.  With
+     * D = M/2 the leading rotation is just (-1)^(m o).
+     */
+    int
+    channelizer::channelize(const gr_complex *in, int noutput_items)
+    {
+      int M = d_nchannels;
+      int L = (int) d_taps.size();
+      gr_complex *branch = d_fft->get_inbuf();
+      const gr_complex *spectrum = d_fft->get_outbuf();
+
+      if (noutput_items < 0) {
+        noutput_items = 0;
+      }
+      if (noutput_items > d_max_output) {
+        d_max_output = noutput_items;
+        d_output.resize(d_max_output * M);
+        if (d_segment > 0) {
+          d_segment_power.resize((d_max_output / d_segment + 1) * M);
+        }
+      }
+      std::fill(d_power.begin(), d_power.end(), 0.0);
+      std::fill(d_segment_power.begin(), d_segment_power.end(), 0.0);
+
+      for (int o = 0; o < noutput_items; o++) {
+        const gr_complex *newest = &in[o * d_decimation + L - 1];
+
+        for (int p = 0; p < M; p++) {
+          gr_complex acc = 0;
+          for (int i = p; i < L; i += M) {
+            acc += newest[-i] * d_taps[i];
+          }
+          branch[p] = acc;
+        }
+
+        d_fft->execute();
+
+        /* channel power comes along while the outputs are still in cache */
+        double *segment = (d_segment > 0) ? &d_segment_power[(o / d_segment) * M] : NULL;
+        for (int m = 0; m < M; m++) {
+          double power = std::norm(spectrum[m]);
+          d_output[m * d_max_output + o] = ((m * o) & 1) ? -spectrum[m] : spectrum[m];
+          d_power[m] += power;
+          if (segment) {
+            segment[m] += power;
+          }
+        }
+      }
+
+      d_noutput_items = noutput_items;
+      return noutput_items;
+    }
+
+    const gr_complex *
+    channelizer::output(int bin) const
+    {
+      return &d_output[bin * d_max_output];
+    }
+
+    double
+    channelizer::power(int bin) const
+    {
+      return d_power[bin];
+    }
+
+    void
+    channelizer::set_power_segment(int outputs)
+    {
+      d_segment = std::max(outputs, 0);
+      if (d_segment > 0) {
+        d_segment_power.resize((d_max_output / d_segment + 1) * d_nchannels);
+      }
+    }
+
+    int
+    channelizer::npower_segments() const
+    {
+      return (d_segment > 0) ? (d_noutput_items / d_segment) : 0;
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
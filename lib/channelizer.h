@@ -0,0 +1,112 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_CHANNELIZER_H
+#define INCLUDED_BLUETOOTH_CHANNELIZER_H
+
+#include <gnuradio/gr_complex.h>
+#include <gnuradio/fft/fft.h>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * Polyphase FFT analysis filter bank.  Splits the wideband input
+     * into nchannels evenly spaced channels (sample_rate / nchannels
+     * apart) in a single pass, decimating each by nchannels / 2 so that
+     * every channel comes out at twice the channel spacing.  Each
+     * channel output matches what a freq_xlating_fir_filter_ccf with
+     * the same prototype taps and decimation would produce.
+     */
+    class channelizer
+    {
+    private:
+      /* number of channels (FFT size) */
+      int d_nchannels;
+
+      /* output decimation, always d_nchannels / 2 */
+      int d_decimation;
+
+      /* prototype low pass filter taps */
+      std::vector<float> d_taps;
+
+      /* inverse FFT across the polyphase branch outputs */
+      gr::fft::fft_complex *d_fft;
+
+      /* channel outputs, one contiguous run of d_max_output per bin */
+      std::vector<gr_complex> d_output;
+      int d_max_output;
+      int d_noutput_items;
+
+      /* summed |y|^2 of each bin's outputs from the last channelize() */
+      std::vector<double> d_power;
+
+      /* the same per run of d_segment outputs, d_nchannels to a segment */
+      int d_segment;
+      std::vector<double> d_segment_power;
+
+    public:
+      channelizer(const std::vector<float> &taps, int nchannels);
+      ~channelizer();
+
+      int nchannels() const { return d_nchannels; }
+      int decimation() const { return d_decimation; }
+
+      /* input samples needed beyond those consumed by the decimation */
+      int history() const { return (int) d_taps.size(); }
+
+      /* number of outputs produced per channel by the last channelize() */
+      int noutput_items() const { return d_noutput_items; }
+
+      /* bin carrying the channel at rel_freq (Hz, relative to center) */
+      int bin(double rel_freq, double sample_rate) const;
+
+      /*
+       * Filter noutput_items outputs for every channel, reading
+       * (noutput_items - 1) * decimation() + history() input samples.
+       */
+      int channelize(const gr_complex *in, int noutput_items);
+
+      /* output of the last channelize() call for one bin */
+      const gr_complex *output(int bin) const;
+
+      /* sum of |output|^2 over the last channelize() call for one bin */
+      double power(int bin) const;
+
+      /* also sum power over every run of that many outputs, 0 for off */
+      void set_power_segment(int outputs);
+
+      /* whole segments in the last channelize() call */
+      int npower_segments() const;
+
+      /* segment s of bin b is at [s * nchannels() + b] */
+      const double *segment_power() const { return &d_segment_power[0]; }
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_CHANNELIZER_H */
@@ -32,6 +32,7 @@ extern "C"
   #include <btbb.h>
 }
 #include <stdio.h>
+#include <boost/bind.hpp>
 
 namespace gr {
   namespace bluetooth {
@@ -53,6 +54,14 @@ namespace gr {
     {
       set_symbol_history(SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE);
 	  btbb_init(1);
+
+      /* each channel keeps its own packet so that workers don't share one */
+      d_scans.resize(num_channels());
+      d_scan_channel = boost::bind(&multi_LAP_impl::scan_channel, this, _1, _2, _3);
+      for (unsigned c = 0; c < d_scans.size(); c++) {
+        d_scans[c].pkt = NULL;
+        d_scans[c].symbols.resize(history() + 40);
+      }
     }
 
     /*
@@ -60,6 +69,52 @@ namespace gr {
      */
     multi_LAP_impl::~multi_LAP_impl()
     {
+      for (unsigned c = 0; c < d_scans.size(); c++) {
+        if (d_scans[c].pkt) {
+          btbb_packet_unref(d_scans[c].pkt);
+        }
+      }
+    }
+
+    /* recover symbols and look for any AC on one channel, run in parallel */
+    void
+    multi_LAP_impl::scan_channel(gr_vector_const_void_star& input_items, int index, double freq)
+    {
+      channel_scan& scan = d_scans[index];
+      int max_ac_errs = 1;
+
+      channel_scratch& sc = d_scratch[index];
+      gr_complex *ch_samples = scratch_samples( index );
+      gr_vector_void_star& btch = sc.sample_out;
+      btch[0] = ch_samples;
+      double on_channel_energy, snr;
+      int ch_count = channel_samples( freq, input_items, btch, on_channel_energy, history() );
+
+      if (check_snr( freq, on_channel_energy, snr, input_items )) {
+        gr_vector_const_void_star& cbtch = sc.sample_in;
+        cbtch[0] = ch_samples;
+        symbol_buffer& packed = scratch_symbols( index );
+        int num_symbols = channel_symbols( freq, cbtch, packed, ch_count );
+          
+        if (num_symbols >= SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) {
+          /* libbtbb takes one symbol per char */
+          if (scan.symbols.size() < (size_t) num_symbols) {
+            scan.symbols.resize(num_symbols);
+            sc.growths++;
+          }
+          char *symbols = &scan.symbols[0];
+          packed.unpack(0, num_symbols, symbols);
+
+          /* don't look beyond one slot for ACs */
+          int latest_ac = ((num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
+            (num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
+          scan.offset = btbb_find_ac(symbols, latest_ac, LAP_ANY, max_ac_errs, &scan.pkt);
+          if (scan.offset >= 0) {
+            // Don't know clkn
+            btbb_packet_set_data(scan.pkt, symbols + scan.offset, num_symbols - scan.offset, (freq/1e6)-2402, 0);
+          }
+        }
+      }
     }
 
     int
@@ -67,41 +122,22 @@ namespace gr {
                          gr_vector_const_void_star &input_items,
                          gr_vector_void_star &output_items)
     {
-	  int offset;
-	  double freq;
-	  char symbols[history()]; //poor estimate but safe
-	  btbb_packet *pkt = NULL;
-	  int max_ac_errs = 1;
+	/* channels found idle are skipped, so start from nothing found */
+	for (unsigned c = 0; c < d_scans.size(); c++) {
+	  d_scans[c].offset = -1;
+	}
+	for_each_channel(input_items, history(), d_scan_channel);
 
-	for (freq = d_low_freq; freq <= d_high_freq; freq += 1e6)
+	/* report in channel order */
+	for (unsigned c = 0; c < d_scans.size(); c++)
 	{
-          gr_complex *ch_samples = new gr_complex[noutput_items+10000];
-          gr_vector_void_star btch( 1 );
-          btch[0] = ch_samples;
-          double on_channel_energy, snr;
-          int ch_count = channel_samples( freq, input_items, btch, on_channel_energy, history() );
-
-          if (check_snr( freq, on_channel_energy, snr, input_items )) {
-            gr_vector_const_void_star cbtch( 1 );
-            cbtch[0] = ch_samples;
-            int num_symbols = channel_symbols( cbtch, symbols, ch_count );
-          
-            if (num_symbols >= SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) {
-              /* don't look beyond one slot for ACs */
-              int latest_ac = ((num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
-                (num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
-			  offset = btbb_find_ac(symbols, latest_ac, LAP_ANY, max_ac_errs, &pkt);
-              if (offset >= 0) {
-				// Don't know clkn
-				btbb_packet_set_data(pkt, symbols + offset, num_symbols - offset, (freq/1e6)-2402, 0);
-                printf("GOT PACKET: ch=%d, LAP=%06x, err=%u at time slot %d\n",
-                       btbb_packet_get_channel(pkt), btbb_packet_get_lap(pkt),
-					   btbb_packet_get_ac_errors(pkt),
-                       (int) (d_cumulative_count / d_samples_per_slot));
-              }
-            }
+          if (d_scans[c].offset >= 0) {
+            btbb_packet *pkt = d_scans[c].pkt;
+            printf("GOT PACKET: ch=%d, LAP=%06x, err=%u at time slot %d\n",
+                   btbb_packet_get_channel(pkt), btbb_packet_get_lap(pkt),
+		   btbb_packet_get_ac_errors(pkt),
+                   (int) (d_cumulative_count / d_samples_per_slot));
           }
-          delete [] ch_samples;
 	}
 	d_cumulative_count += (int) d_samples_per_slot;
 
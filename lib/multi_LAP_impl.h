@@ -25,6 +25,9 @@
 #define INCLUDED_BLUETOOTH_GR_BLUETOOTH_MULTI_LAP_IMPL_H
 
 #include "gr_bluetooth/multi_LAP.h"
+#include <vector>
+
+typedef struct btbb_packet btbb_packet;
 
 namespace gr {
   namespace bluetooth {
@@ -32,7 +35,23 @@ namespace gr {
     class multi_LAP_impl : virtual public multi_LAP
     {
     private:
-      // Nothing to declare in this block.
+      /* what one channel turned up in the current time slot */
+      struct channel_scan {
+        int               offset;
+        btbb_packet      *pkt;
+
+        /* channel symbols unpacked for libbtbb, one per char */
+        std::vector<char> symbols;
+      };
+
+      /* per channel results, indexed from d_low_freq */
+      std::vector<channel_scan> d_scans;
+
+      /* recover symbols and look for any AC on one channel, run in parallel */
+      void scan_channel(gr_vector_const_void_star& input_items, int index, double freq);
+
+      /* scan_channel() bound once for for_each_channel() */
+      channel_fn d_scan_channel;
 
     public:
       multi_LAP_impl(double sample_rate, double center_freq, double squelch_threshold);
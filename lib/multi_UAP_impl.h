@@ -27,6 +27,7 @@
 #define INCLUDED_BLUETOOTH_GR_BLUETOOTH_MULTI_UAP_IMPL_H
 
 #include "gr_bluetooth/multi_UAP.h"
+#include <vector>
 extern "C"
 {
   #include <btbb.h>
@@ -44,6 +45,24 @@ namespace gr {
       /* the piconet we are monitoring */
       btbb_piconet *d_piconet;
 
+      /* what one channel turned up in the current time slot */
+      struct channel_scan {
+        int               offset;
+        btbb_packet      *pkt;
+
+        /* channel symbols unpacked for libbtbb, one per char */
+        std::vector<char> symbols;
+      };
+
+      /* per channel results, indexed from d_low_freq */
+      std::vector<channel_scan> d_scans;
+
+      /* recover symbols and look for our AC on one channel, run in parallel */
+      void scan_channel(gr_vector_const_void_star& input_items, int index, double freq);
+
+      /* scan_channel() bound once for for_each_channel() */
+      channel_fn d_scan_channel;
+
     public:
       multi_UAP_impl(double sample_rate, double center_freq, double squelch_threshold, int LAP);
       ~multi_UAP_impl();
@@ -30,23 +30,50 @@
 #include <gnuradio/io_signature.h>
 #include "gr_bluetooth/multi_block.h"
 #include "gr_bluetooth/packet.h"
+#include "channelizer.h"
+#include "worker_pool.h"
+#include "power.h"
+#include "symbol_kernels.h"
+#include "band_scan.h"
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
 #include <gnuradio/filter/firdes.h>
 #include <gnuradio/math.h>
 #include <stdio.h>
-#include <gnuradio/blocks/complex_to_mag_squared.h>
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
 
 namespace gr {
   namespace bluetooth {
+
+    /*
+     * most dB a channel's loudest band scan segment need be above the
+     * floor before it is filtered at all; kept low since check_snr() has
+     * the final say
+     */
+    static const double BAND_SCAN_THRESHOLD = 3.0;
+
     multi_block::multi_block(double sample_rate, double center_freq, double squelch_threshold)
       : gr::sync_block ("bluetooth multi block",
                        gr::io_signature::make (1, 1, sizeof (gr_complex)),
                        gr::io_signature::make (0, 0, 0))
     {
       d_target_snr = squelch_threshold;
+      d_band_scan_threshold = std::min( BAND_SCAN_THRESHOLD, d_target_snr );
 
       d_cumulative_count = 0;
       d_sample_rate = sample_rate;
       d_center_freq = center_freq;
+      d_channelizer = NULL;
+      d_channelized_count = ~0ULL;
+      d_streaming = false;
+      d_stream_next_output = 0;
+      d_stream_first_output = 0;
+      d_streamed_count = ~0ULL;
+      d_stream_symbols = 0;
+      d_stream_list = NULL;
+      d_scanned_count = ~0ULL;
 
       /*
        * how many time slots we attempt to decode on each hop:
@@ -95,7 +122,35 @@ namespace gr {
       d_gain_omega = .25 * d_gain_mu * d_gain_mu;
       d_omega_mid = d_omega;
       d_interp = new gr::filter::mmse_fir_interpolator_ff();
-      d_last_sample = 0;
+
+      /* set up per channel state now so that workers never resize it */
+      if (d_high_freq >= d_low_freq) {
+        (void) channel_clock_recovery( abs_freq_channel( d_high_freq ) );
+      }
+      d_workers = new worker_pool( worker_pool::default_nthreads( num_channels( ) ) );
+      d_channel_in = NULL;
+      d_channel_fn = NULL;
+      d_stream_noutput_items = 0;
+      d_channel_task = boost::bind( &multi_block::channel_task, this, _1 );
+      d_stream_task  = boost::bind( &multi_block::stream_channel, this, _1 );
+
+      /* the scan sums the middle 800 kHz of each channel */
+      std::vector<double> rel_freqs;
+      for( int i=0; i<num_channels( ); i++ ) {
+        rel_freqs.push_back( d_low_freq + i * (double) CHANNEL_WIDTH - d_center_freq );
+      }
+      d_band_scan = new band_scan( d_sample_rate, rel_freqs, 0.8 * CHANNEL_WIDTH );
+      d_active_channels.reserve( num_channels( ) );
+      d_idle_slots.assign( num_channels( ), INT_MAX );
+
+      /* with a channelizer, the scan takes its power per segment instead of an FFT of its own */
+      if (d_channelizer) {
+        d_channelizer->set_power_segment( std::max( 1, d_band_scan->segment_samples( ) /
+                                                        d_channelizer->decimation( ) ) );
+        for( int i=0; i<num_channels( ); i++ ) {
+          d_scan_bins.push_back( d_channel_bins[abs_freq_channel( d_low_freq ) + i] );
+        }
+      }
       
       /* the required history is the slot data + the max of either
          channed DDC + demod, or noise DDC */
@@ -117,8 +172,25 @@ namespace gr {
               history_required, channel_history, noise_history );
 
       set_history( history_required );
+      size_scratch( );
     }  
 
+    multi_block::~multi_block()
+    {
+      if (scratch_growths( ) > 0) {
+        GR_LOG_DEBUG( d_debug_logger,
+                      boost::format( "scratch buffers grew %lu times on the sample path" )
+                      % scratch_growths( ) );
+      }
+      delete d_workers;
+      delete d_band_scan;
+      delete d_channelizer;
+      for( unsigned i=0; i<d_clock_recovery.size( ); i++ ) {
+        delete d_clock_recovery[i].interp;
+      }
+      delete d_interp;
+    }
+
     static inline float slice(float x)
     {
       return (x < 0) ? -1.0F : 1.0F;
@@ -126,55 +198,257 @@ namespace gr {
 
     /* M&M clock recovery, adapted from gr_clock_recovery_mm_ff */
     int 
-    multi_block::mm_cr(const float *in, int ninput_items, float *out, int noutput_items)
+    multi_block::mm_cr(clock_recovery& cr, const float *in, int ninput_items,
+                       float *out, int noutput_items, int *ninput_consumed)
     {
       unsigned int ii = 0; /* input index */
       int          oo = 0; /* output index */
       unsigned int ni = ninput_items - d_interp->ntaps(); /* max input */
       float        mm_val;
 
+      /* a carried over mu may point past the first input sample */
+      ii      = (unsigned int) floor( cr.mu );
+      cr.mu  -= floor( cr.mu );
+
       while ((oo < noutput_items) && (ii < ni)) {
         // produce output sample
-		//printf("d_mu %3.3f\n", d_mu);
-        out[oo]       = d_interp->interpolate( &in[ii], d_mu );
-        mm_val        = slice(d_last_sample) * out[oo] - slice(out[oo]) * d_last_sample;
-        d_last_sample = out[oo];
+        out[oo]        = cr.interp->interpolate( &in[ii], cr.mu );
+        mm_val         = slice(cr.last_sample) * out[oo] - slice(out[oo]) * cr.last_sample;
+        cr.last_sample = out[oo];
         
-        d_omega += d_gain_omega * mm_val;
-        d_omega  = d_omega_mid + gr::branchless_clip( d_omega-d_omega_mid, 
-                                                     d_omega_relative_limit );   // make sure we don't walk away
-        d_mu    += d_omega + d_gain_mu * mm_val;
+        cr.omega += d_gain_omega * mm_val;
+        cr.omega  = d_omega_mid + gr::branchless_clip( cr.omega-d_omega_mid, 
+                                                      d_omega_relative_limit );   // make sure we don't walk away
+        cr.mu    += cr.omega + d_gain_mu * mm_val;
 
-        ii      += (int) floor( d_mu );
-        d_mu    -= floor( d_mu );
+        ii       += (int) floor( cr.mu );
+        cr.mu    -= floor( cr.mu );
         oo++;
       }
 
+      if (ninput_consumed) {
+        *ninput_consumed = ii;
+      }
+
       /* return number of output items produced */
       return oo;
     }
 
+    multi_block::clock_recovery&
+    multi_block::channel_clock_recovery(int channel)
+    {
+      if (channel >= (int) d_clock_recovery.size( )) {
+        int first = d_clock_recovery.size( );
+        clock_recovery initial;
+        initial.mu          = d_mu;
+        initial.omega       = d_omega_mid;
+        initial.last_sample = 0;
+        initial.origin      = 0;
+        initial.have_origin = false;
+        initial.interp      = NULL;
+        d_clock_recovery.resize( channel + 1, initial );
+        for( int ch=first; ch<=channel; ch++ ) {
+          d_clock_recovery[ch].interp = new gr::filter::mmse_fir_interpolator_ff();
+        }
+      }
+      return d_clock_recovery[channel];
+    }
+
     /* fm demodulation, taken from gr_quadrature_demod_cf */
     void 
     multi_block::demod(const gr_complex *in, float *out, int noutput_items)
     {
-      int i;
-      gr_complex product;
+      quadrature_demod(in, out, noutput_items, d_demod_gain);
+    }
+
+    /* binary slicer, similar to gr_binary_slicer_fb, appending to out */
+    void 
+    multi_block::slicer(const float *in, symbol_buffer& out, int noutput_items)
+    {
+      append_sliced(in, noutput_items, out);
+    }
+
+    void
+    multi_block::channelize( gr_vector_const_void_star& in,
+                             int                        ninput_items )
+    {
+      if (!d_channelizer || (d_channelized_count == d_cumulative_count)) {
+        return;
+      }
+      d_channelized_count = d_cumulative_count;
+
+      int L = d_channelizer->history( );
+      int D = d_channelizer->decimation( );
+      if (!d_streaming) {
+        /* same span of input that a per-channel DDC would filter */
+        int ddc_samples = ninput_items - (L - 1) - d_first_channel_sample;
+        int noutput_items = std::max( 0, ddc_samples - L + 1 ) / D;
+        d_channelizer->channelize( &(((gr_complex *) in[0])[d_first_channel_sample]), noutput_items );
+        return;
+      }
 
-      for (i = 1; i < noutput_items; i++) {
-        gr_complex product = in[i] * conj (in[i-1]);
-        out[i] = d_demod_gain * gr::fast_atan2f(imag(product), real(product));
+      if (d_streams.empty( )) {
+        /* history() is final by the time the first slot arrives */
+        int window = history( ) - d_first_channel_sample - L;
+        d_stream_symbols = (int) ((window - D * d_interp->ntaps( )) / d_samples_per_symbol);
+        int slots = (int) ceil( window / (double) d_samples_per_slot );
+        std::map<int, int>::const_iterator bini;
+        for( bini=d_channel_bins.begin( ); bini!=d_channel_bins.end( ); bini++ ) {
+          channel_stream& st = d_streams[bini->first];
+          st.bin = bini->second;
+          st.next_output = ~0ULL;
+          st.slot_energy.resize( slots );
+          st.slot_count.resize( slots );
+          st.demod.reserve( history( ) / D + 2 );
+          st.symbols.reserve( 3 * d_stream_symbols + SYMBOLS_PER_BASIC_RATE_SLOT );
+          d_stream_channels.push_back( bini->first - abs_freq_channel( d_low_freq ) );
+        }
       }
+
+      /*
+       * Output o of the stream has its newest input sample at absolute
+       * index o*D + L-1.  Anything older than this slot's input window
+       * is gone, so if we fell behind (first slot, or a slot in which
+       * no channel was requested) the streams pick up from the oldest
+       * output still there, and restart_stream() sees the gap.
+       */
+      uint64_t first_output = (d_cumulative_count + D - 1) / D;
+      uint64_t end_output   = (d_cumulative_count + ninput_items - L) / D + 1;
+      if (d_stream_next_output < first_output) {
+        d_stream_next_output = first_output;
+      }
+      d_stream_first_output = d_stream_next_output;
+      if (end_output <= d_stream_next_output) {
+        d_stream_noutput_items = 0;
+        return;
+      }
+
+      d_stream_noutput_items = (int) (end_output - d_stream_next_output);
+      int offset = (int) (d_stream_next_output * D - d_cumulative_count);
+      d_channelizer->channelize( &(((gr_complex *) in[0])[offset]), d_stream_noutput_items );
+      d_stream_next_output = end_output;
     }
 
-    /* binary slicer, similar to gr_binary_slicer_fb */
-    void 
-    multi_block::slicer(const float *in, char *out, int noutput_items)
+    void
+    multi_block::restart_stream( int channel, channel_stream& st )
     {
-      int i;
+      clock_recovery& cr = channel_clock_recovery( channel );
 
-      for (i = 0; i < noutput_items; i++)
-        out[i] = (in[i] < 0) ? 0 : 1;
+      /*
+       * mu counts from the oldest demodulated sample still queued; after
+       * the restart that is the second sample of this slot, since the
+       * first only seeds the demodulator
+       */
+      double position = 0.0;
+      bool   carry    = false;
+      if (st.next_output != ~0ULL) {
+        int64_t queued_from = (int64_t) (st.next_output - st.demod.size( ));
+        position = cr.mu + (double) (queued_from - (int64_t) (d_stream_first_output + 1));
+        carry    = fabs( position ) < MAX_CLOCK_RECOVERY_GAP * cr.omega;
+      }
+      if (carry) {
+        cr.mu = position - floor( position / cr.omega ) * cr.omega;
+      }
+      else {
+        /* symbol timing is lost, but the symbol rate estimate still holds */
+        cr.mu = d_mu;
+      }
+      cr.last_sample = 0;
+
+      st.have_last_sample = false;
+      st.demod.clear( );
+      st.symbols.clear( );
+      st.head = 0;
+      std::fill( st.slot_energy.begin( ), st.slot_energy.end( ), 0.0 );
+      std::fill( st.slot_count.begin( ), st.slot_count.end( ), 0 );
+      st.slot_index = 0;
+    }
+
+    void
+    multi_block::stream_channels( gr_vector_const_void_star& in,
+                                  int                        ninput_items )
+    {
+      channelize( in, ninput_items );
+      if (d_streamed_count == d_cumulative_count) {
+        return;
+      }
+      d_streamed_count = d_cumulative_count;
+
+      /* without a scan this slot (hopalong() and the like) every channel has to keep up */
+      d_stream_list = (d_scanned_count == d_cumulative_count) ? &d_active_channels : &d_stream_channels;
+      d_workers->parallel_for( d_stream_list->size( ), d_stream_task );
+    }
+
+    void
+    multi_block::stream_channel( int index )
+    {
+      int noutput_items = d_stream_noutput_items;
+      int channel = abs_freq_channel( d_low_freq ) + (*d_stream_list)[index];
+      channel_stream& st = d_streams.find( channel )->second;
+      const gr_complex *ch_out = d_channelizer->output( st.bin );
+
+      if (st.next_output != d_stream_first_output) {
+        restart_stream( channel, st );
+      }
+      st.next_output = d_stream_first_output + noutput_items;
+
+      st.slot_index = (st.slot_index + 1) % st.slot_energy.size( );
+      st.slot_energy[st.slot_index] = d_channelizer->power( st.bin );
+      st.slot_count[st.slot_index]  = noutput_items;
+
+      stream_symbols( channel, st, d_scratch[(*d_stream_list)[index]], ch_out, noutput_items );
+    }
+
+    void
+    multi_block::stream_symbols( int               channel,
+                                 channel_stream&   st,
+                                 channel_scratch&  sc,
+                                 const gr_complex *samples,
+                                 int               nsamples )
+    {
+      /* fm demodulation, continuing from the previous slot's last sample */
+      if (nsamples < 1) {
+        return;
+      }
+      gr_complex *demod_in = scratch_buffer( sc, sc.demod_in, nsamples + 1 );
+      demod_in[0] = st.have_last_sample ? st.last_sample : samples[0];
+      std::copy( samples, samples + nsamples, demod_in + 1 );
+      int skip = st.have_last_sample ? 0 : 1;
+      float *demod_out = scratch_buffer( sc, sc.demod_out, nsamples + 1 );
+      demod( demod_in, demod_out, nsamples + 1 );
+      if (st.demod.capacity( ) < st.demod.size( ) + nsamples) {
+        sc.growths++;
+      }
+      st.demod.insert( st.demod.end( ), demod_out + 1 + skip, demod_out + nsamples + 1 );
+      st.last_sample = samples[nsamples - 1];
+      st.have_last_sample = true;
+
+      /* clock recovery, picking up where the previous slot left off */
+      int cr_ninput_items = st.demod.size( );
+      if (cr_ninput_items <= (int) d_interp->ntaps( )) {
+        return;
+      }
+      float *cr_out = scratch_buffer( sc, sc.cr_out, cr_ninput_items );
+      int consumed = 0;
+      int noutput_items = mm_cr( channel_clock_recovery( channel ), &st.demod[0], cr_ninput_items,
+                                 cr_out, cr_ninput_items, &consumed );
+      st.demod.erase( st.demod.begin( ), st.demod.begin( ) + consumed );
+
+      /* binary slicer, appending to the symbol window */
+      int end = st.symbols.size( );
+      if (st.symbols.capacity( ) < end + noutput_items) {
+        sc.growths++;
+      }
+      slicer( cr_out, st.symbols, noutput_items );
+
+      int window = st.symbols.size( ) - st.head;
+      if (window > d_stream_symbols) {
+        st.head += window - d_stream_symbols;
+      }
+      if (st.head > d_stream_symbols) {
+        st.symbols.erase_front( st.head );
+        st.head = 0;
+      }
     }
 
     int 
@@ -188,14 +462,35 @@ namespace gr {
       int classic_chan = abs_freq_channel( freq );
       std::map<int, gr::filter::freq_xlating_fir_filter_ccf::sptr>::const_iterator ddci = 
         d_channel_ddcs.find( classic_chan );
-
-      if (ddci != d_channel_ddcs.end( )) {
+      std::map<int, int>::const_iterator bini = d_channel_bins.find( classic_chan );
+
+      if (d_streaming && (bini != d_channel_bins.end( ))) {
+        stream_channels( in, ninput_items );
+        const channel_stream& st = d_streams.find( classic_chan )->second;
+        double total = 0.0;
+        int count = 0;
+        for( unsigned i=0; i<st.slot_energy.size( ); i++ ) {
+          total += st.slot_energy[i];
+          count += st.slot_count[i];
+        }
+        energy = (count > 0) ? (total / count) : 0.0;
+        ddc_noutput_items = st.symbols.size( ) - st.head;
+      }
+      else if (d_channelizer && (bini != d_channel_bins.end( ))) {
+        channelize( in, ninput_items );
+        ddc_noutput_items = d_channelizer->noutput_items( );
+        const gr_complex *ch_out = d_channelizer->output( bini->second );
+        memcpy( out[0], ch_out, ddc_noutput_items * sizeof( gr_complex ) );
+        energy = (ddc_noutput_items > 0) ? 
+          (d_channelizer->power( bini->second ) / ddc_noutput_items) : 0.0;
+      }
+      else if (ddci != d_channel_ddcs.end( )) {
         gr::filter::freq_xlating_fir_filter_ccf::sptr ddc = ddci->second;
         int ddc_samples = ninput_items - (ddc->history( ) - 1) - d_first_channel_sample;
 		// This changes how many iterations it takes to crash... Definitely on to something.
 		//printf("ddc_samples: %i\n", ddc_samples);
 		//printf("fcs: %i\n", d_first_channel_sample);
-        gr_vector_const_void_star ddc_in( 1 );
+        gr_vector_const_void_star& ddc_in = scratch( freq ).ddc_in;
         ddc_in[0] = &(((gr_complex *) in[0])[d_first_channel_sample]);
         ddc_noutput_items = ddc->fixed_rate_ninput_to_noutput( ddc_samples ); // ddc_samples
 		//printf("ddc_noutput_items: %i\n", ddc_noutput_items);
@@ -203,20 +498,8 @@ namespace gr {
 		//ddc_out[0] = out[0];//malloc(100000);
         ddc_noutput_items = ddc->work( ddc_noutput_items, ddc_in, out );
 		//printf("after work %i\n", ddc_noutput_items);
-        gr::blocks::complex_to_mag_squared::sptr mag2 = gr::blocks::complex_to_mag_squared::make( 1 );
-		//printf("past\n");
-        float *mag2_out = new float[ddc_noutput_items];
-        gr_vector_void_star mag2_out_vector( 1 );
-        mag2_out_vector[0] = &mag2_out[0];
-        gr_vector_const_void_star ddc_out_const( 1 );
-        ddc_out_const[0] = out[0];
-        (void) mag2->work( ddc_noutput_items, ddc_out_const, mag2_out_vector );
-        energy = 0.0;
-        for( unsigned i=0; i<ddc_noutput_items; i++ ) {
-          energy += mag2_out[i];
-        }
-        energy /= ddc_noutput_items;
-		delete [] mag2_out;
+        /* averaged straight off the DDC output while it is still in cache */
+        energy = mean_power( (const gr_complex *) out[0], ddc_noutput_items );
 		//free(ddc_out[0]);
         //energy /= d_channel_filter_width;
       }
@@ -228,26 +511,98 @@ namespace gr {
     }
 
     int 
-    multi_block::channel_symbols( gr_vector_const_void_star& in, 
-                                  char *                     out, 
+    multi_block::channel_symbols( const double               freq,
+                                  gr_vector_const_void_star& in, 
+                                  symbol_buffer&             out, 
                                   int                        ninput_items )
     {
+      out.clear( );
+      if (d_streaming) {
+        std::map<int, channel_stream>::const_iterator sti = 
+          d_streams.find( abs_freq_channel( freq ) );
+        if (sti != d_streams.end( )) {
+          const channel_stream& st = sti->second;
+          int len = st.symbols.size( ) - st.head;
+          if (len > 0) {
+            /*
+             * A stream that started over lately has less than a full
+             * window.  Zeros in front keep its symbols where a full
+             * window would have them, so that the first slot of the
+             * window, which callers search, still moves on each slot.
+             */
+            if (len < d_stream_symbols) {
+              out.resize( d_stream_symbols - len );
+            }
+            out.append( st.symbols, st.head, len );
+          }
+          return out.size( );
+        }
+      }
+
       /* fm demodulation */
       int demod_noutput_items = ninput_items - 1;
-      float demod_out[demod_noutput_items];
+      if (demod_noutput_items < 1) {
+        return 0;
+      }
+      channel_scratch& sc = scratch( freq );
+      float *demod_out = scratch_buffer( sc, sc.demod_out, demod_noutput_items );
       gr_complex *ch_samps = (gr_complex *) in[0];
       demod( ch_samps, demod_out, demod_noutput_items );
       
-      /* clock recovery */
+      /*
+       * clock recovery, resuming this channel's loop from where it left
+       * off last time.  The loop's state is saved as it passes the start
+       * of the next window, one slot in, so consecutive windows carry
+       * on from it directly.  Across skipped slots the symbol clock is
+       * assumed to free-run at the recovered rate.
+       */
       int cr_ninput_items = demod_noutput_items;
       int noutput_items = cr_ninput_items; // poor estimate but probably safe
-      float cr_out[noutput_items];
-      noutput_items = mm_cr(demod_out, cr_ninput_items, cr_out, noutput_items);
+      float *cr_out = scratch_buffer( sc, sc.cr_out, noutput_items );
+      clock_recovery& cr = channel_clock_recovery( abs_freq_channel( freq ) );
+      int64_t window_origin = d_cumulative_count + d_first_channel_sample;
+      double  position = 0.0;
+      if (cr.have_origin) {
+        position = ((int64_t) cr.origin - window_origin) / (double) d_ddc_decimation_rate + cr.mu;
+      }
+      if (cr.have_origin && (fabs( position ) < MAX_CLOCK_RECOVERY_GAP * cr.omega)) {
+        if (position >= 0) {
+          /* the next symbol is position samples into this window */
+          cr.mu = position;
+        }
+        else {
+          cr.mu = position - floor( position / cr.omega ) * cr.omega;
+          cr.last_sample = 0;
+        }
+      }
+      else {
+        cr.mu          = d_mu;
+        cr.last_sample = 0;
+      }
+      int ntaps = d_interp->ntaps( );
+      int carry_at = std::max( 0, std::min( (int) (d_samples_per_slot / d_ddc_decimation_rate),
+                                            cr_ninput_items - ntaps ) );
+      int consumed = 0;
+      int carried_outputs = mm_cr(cr, demod_out, carry_at + ntaps, cr_out, noutput_items, &consumed);
+      clock_recovery carried = cr;
+      if (cr_ninput_items - consumed > ntaps) {
+        noutput_items = carried_outputs +
+          mm_cr(cr, &demod_out[consumed], cr_ninput_items - consumed,
+                &cr_out[carried_outputs], noutput_items - carried_outputs);
+      }
+      else {
+        noutput_items = carried_outputs;
+      }
+      cr.mu          = carried.mu;
+      cr.omega       = carried.omega;
+      cr.last_sample = carried.last_sample;
+      cr.origin      = window_origin + (int64_t) consumed * d_ddc_decimation_rate;
+      cr.have_origin = true;
       
       /* binary slicer */
       slicer(cr_out, out, noutput_items);
       
-      return noutput_items;
+      return out.size( );
     }
 
     bool 
@@ -264,26 +619,17 @@ namespace gr {
 
       if (nddci != d_noise_ddcs.end( )) {
         gr::filter::freq_xlating_fir_filter_ccf::sptr nddc = nddci->second;
-        gr_vector_const_void_star ddc_in( 1 );
+        channel_scratch& sc = scratch( freq );
+        gr_vector_const_void_star& ddc_in = sc.ddc_in;
         ddc_in[0] = &(((gr_complex *) in[0])[d_first_noise_sample]);
         int ddc_noutput_items = nddc->fixed_rate_ninput_to_noutput( (int) d_samples_per_slot );
-        gr_complex ddc_out[ddc_noutput_items];
-        gr_vector_void_star ddc_out_vector( 1 );
-        gr_vector_const_void_star ddc_out_const( 1 );
-        ddc_out_vector[0] = &ddc_out[0];
-        ddc_out_const[0]  = &ddc_out[0];
+        gr_complex *ddc_out = scratch_buffer( sc, sc.noise, ddc_noutput_items );
+        gr_vector_void_star& ddc_out_vector = sc.ddc_out;
+        ddc_out_vector[0] = ddc_out;
         ddc_noutput_items = nddc->work( ddc_noutput_items, ddc_in, ddc_out_vector );
       
         // average mag2 for valley
-        gr::blocks::complex_to_mag_squared::sptr mag2 = gr::blocks::complex_to_mag_squared::make( 1 );
-        float mag2_out[ddc_noutput_items];
-        gr_vector_void_star mag2_out_vector( 1 );
-        mag2_out_vector[0] = &mag2_out[0];
-        (void) mag2->work( ddc_noutput_items, ddc_out_const, mag2_out_vector );
-        for( unsigned i=0; i<ddc_noutput_items; i++ ) {
-          off_channel_energy += mag2_out[i];
-        }
-        off_channel_energy /= ddc_noutput_items;
+        off_channel_energy = mean_power( ddc_out, ddc_noutput_items );
         //off_channel_energy /= d_noise_filter_width;
       }
       else {
@@ -300,6 +646,62 @@ namespace gr {
     multi_block::set_symbol_history(int num_symbols)
     {
       set_history((int) (history() + (num_symbols * d_samples_per_symbol)));
+      size_scratch( );
+    }
+
+    void
+    multi_block::size_scratch( )
+    {
+      d_scratch.resize( num_channels( ) );
+      for( unsigned i=0; i<d_scratch.size( ); i++ ) {
+        channel_scratch& sc = d_scratch[i];
+        size_t channel_samples = history( ) / d_ddc_decimation_rate + 2;
+        sc.samples.resize( channel_samples );
+        sc.symbols.reserve( history( ) + 40 );
+        sc.demod_in.resize( channel_samples + 1 );
+        sc.demod_out.resize( channel_samples + 1 );
+        sc.cr_out.resize( channel_samples + 1 );
+        sc.noise.resize( (size_t) (d_samples_per_slot / d_ddc_decimation_rate) + 1 );
+        sc.ddc_in.resize( 1 );
+        sc.ddc_out.resize( 1 );
+        sc.sample_in.resize( 1 );
+        sc.sample_out.resize( 1 );
+        sc.growths = 0;
+      }
+    }
+
+    multi_block::channel_scratch&
+    multi_block::scratch( double freq )
+    {
+      return d_scratch[abs_freq_channel( freq ) - abs_freq_channel( d_low_freq )];
+    }
+
+    gr_complex *
+    multi_block::scratch_samples( int index )
+    {
+      channel_scratch& sc = d_scratch[index];
+      return scratch_buffer( sc, sc.samples, history( ) / d_ddc_decimation_rate + 2 );
+    }
+
+    symbol_buffer&
+    multi_block::scratch_symbols( int index )
+    {
+      channel_scratch& sc = d_scratch[index];
+      if (sc.symbols.capacity( ) < history( ) + 40) {
+        sc.symbols.reserve( history( ) + 40 );
+        sc.growths++;
+      }
+      return sc.symbols;
+    }
+
+    unsigned long
+    multi_block::scratch_growths( ) const
+    {
+      unsigned long growths = 0;
+      for( unsigned i=0; i<d_scratch.size( ); i++ ) {
+        growths += d_scratch[i].growths;
+      }
+      return growths;
     }
 
     /* set available channels based on d_center_freq and d_sample_rate */
@@ -326,13 +728,36 @@ namespace gr {
       d_low_freq = channel_abs_freq(low_classic_channel);
       d_high_freq = channel_abs_freq(high_classic_channel);
 
+      /*
+       * When the sample rate is an even multiple of the channel width
+       * and the center frequency sits on the channel raster, one
+       * polyphase channelizer replaces the per-channel DDCs.
+       */
+      double raster_channels = d_sample_rate / CHANNEL_WIDTH;
+      double raster_offset   = (d_center_freq - BASE_FREQUENCY) / CHANNEL_WIDTH;
+      int nchannels = (int) lround( raster_channels );
+      if ((fabs( raster_channels - nchannels ) < 1e-9) &&
+          (fabs( raster_offset - lround( raster_offset ) ) < 1e-9) &&
+          (nchannels >= 2) && ((nchannels % 2) == 0) &&
+          ((nchannels / 2) == d_ddc_decimation_rate)) {
+        d_channelizer = new channelizer( d_channel_filter, nchannels );
+        d_streaming = true;
+        GR_LOG_DEBUG( d_debug_logger,
+                      boost::format( "using %d channel polyphase channelizer" ) % nchannels );
+      }
+
       for( int ch=low_classic_channel; ch<=high_classic_channel; ch++ ) {
         double freq = channel_abs_freq( ch );
-        d_channel_ddcs[ch] = 
-          gr::filter::freq_xlating_fir_filter_ccf::make( d_ddc_decimation_rate, 
-                                               d_channel_filter, 
-                                               freq-d_center_freq, 
-                                               d_sample_rate );
+        if (d_channelizer) {
+          d_channel_bins[ch] = d_channelizer->bin( freq-d_center_freq, d_sample_rate );
+        }
+        else {
+          d_channel_ddcs[ch] = 
+            gr::filter::freq_xlating_fir_filter_ccf::make( d_ddc_decimation_rate, 
+                                                 d_channel_filter, 
+                                                 freq-d_center_freq, 
+                                                 d_sample_rate );
+        }
         d_noise_ddcs[ch] = 
           gr::filter::freq_xlating_fir_filter_ccf::make( d_ddc_decimation_rate, 
                                                d_noise_filter, 
@@ -341,6 +766,94 @@ namespace gr {
       }
     }
 
+    int
+    multi_block::num_channels( )
+    {
+      if (d_high_freq < d_low_freq) {
+        return 0;
+      }
+      return abs_freq_channel( d_high_freq ) - abs_freq_channel( d_low_freq ) + 1;
+    }
+
+    void
+    multi_block::for_each_channel( gr_vector_const_void_star& in,
+                                   int                        ninput_items,
+                                   const channel_fn&          fn )
+    {
+      /*
+       * The channelizer is shared, so it runs here rather than in a
+       * worker, ahead of the scan that reads its power.  Only the
+       * channels the scan passes are then streamed.
+       */
+      channelize( in, ninput_items );
+      scan_band( in, ninput_items );
+      if (d_streaming) {
+        stream_channels( in, ninput_items );
+      }
+      d_channel_in = &in;
+      d_channel_fn = &fn;
+      d_workers->parallel_for( d_active_channels.size( ), d_channel_task );
+      d_channel_in = NULL;
+      d_channel_fn = NULL;
+    }
+
+    void
+    multi_block::channel_task( int active )
+    {
+      int index = d_active_channels[active];
+      (*d_channel_fn)( *d_channel_in, index, d_low_freq + index * (double) CHANNEL_WIDTH );
+    }
+
+    void
+    multi_block::scan_band( gr_vector_const_void_star& in,
+                            int                        ninput_items )
+    {
+      /* what a channel sends is searched for until it leaves the window */
+      int window_slots = (int) ceil( ninput_items / d_samples_per_slot );
+      bool conclusive = false;
+
+      d_scanned_count = d_cumulative_count;
+      if (d_band_scan_threshold > 0.0) {
+        if (d_streaming) {
+          /* the channelizer has just filtered this slot's new input */
+          d_band_scan->scan( d_channelizer->segment_power( ), d_channelizer->npower_segments( ),
+                             d_channelizer->nchannels( ), d_scan_bins );
+        }
+        else {
+          /* only the newest slot of input, the older ones were scanned as they came in */
+          int nsamples = std::min( (int) d_samples_per_slot, ninput_items - d_first_channel_sample );
+          d_band_scan->scan( &(((const gr_complex *) in[0])[ninput_items - nsamples]), nsamples );
+        }
+        conclusive = d_band_scan->conclusive( );
+      }
+
+      d_active_channels.clear( );
+      for( int i=0; i<num_channels( ); i++ ) {
+        /* scan turned off, or it can't tell channels from noise: count them all as heard */
+        if (!conclusive || (d_band_scan->peak_snr( i ) >= d_band_scan_threshold)) {
+          d_idle_slots[i] = 0;
+        }
+        else if (d_idle_slots[i] < INT_MAX) {
+          d_idle_slots[i]++;
+        }
+        if (d_idle_slots[i] < window_slots) {
+          d_active_channels.push_back( i );
+        }
+      }
+    }
+
+    void
+    multi_block::set_band_scan_threshold( double threshold )
+    {
+      d_band_scan_threshold = threshold;
+    }
+
+    double
+    multi_block::band_scan_threshold( ) const
+    {
+      return d_band_scan_threshold;
+    }
+
     /* returns relative (with respect to d_center_freq) frequency in Hz of given channel */
     double 
     multi_block::channel_rel_freq(int channel)
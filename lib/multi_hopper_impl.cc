@@ -29,6 +29,7 @@
 
 #include <gnuradio/io_signature.h>
 #include "multi_hopper_impl.h"
+#include <boost/bind.hpp>
 
 namespace gr {
   namespace bluetooth {
@@ -52,7 +53,11 @@ namespace gr {
 	d_aliased = aliased;
 	d_tun = tun;
 	set_symbol_history(SYMBOLS_FOR_BASIC_RATE_HISTORY);
+	d_scans.resize(num_channels());
+	d_scan_channel = boost::bind(&multi_hopper_impl::scan_channel, this, _1, _2, _3);
 	d_piconet = basic_rate_piconet::make(d_LAP);
+	d_reversal_thread = NULL;
+	d_reversal_done = false;
 
 	/* Tun interface */
 	if(d_tun) {
@@ -71,6 +76,78 @@ namespace gr {
      */
     multi_hopper_impl::~multi_hopper_impl()
     {
+      if (d_reversal_thread) {
+        d_reversal_thread->join();
+        delete d_reversal_thread;
+      }
+    }
+
+    void
+    multi_hopper_impl::start_hop_reversal()
+    {
+      d_reversal_done = false;
+      d_reversal_thread = new gr::thread::thread(boost::bind(&multi_hopper_impl::run_hop_reversal, this));
+    }
+
+    void
+    multi_hopper_impl::run_hop_reversal()
+    {
+      d_piconet->init_hop_reversal(d_aliased);
+
+      gr::thread::scoped_lock lock(d_reversal_mutex);
+      d_reversal_done = true;
+    }
+
+    void
+    multi_hopper_impl::finish_hop_reversal()
+    {
+      {
+        gr::thread::scoped_lock lock(d_reversal_mutex);
+        if (!d_reversal_done) {
+          return;
+        }
+      }
+      d_reversal_thread->join();
+      delete d_reversal_thread;
+      d_reversal_thread = NULL;
+
+      /* use previously observed packets to eliminate candidates */
+      d_piconet->winnow();
+
+      /* then those that came in while the candidates were found */
+      std::vector<classic_packet::sptr> pending;
+      pending.swap(d_pending_packets);
+      for (unsigned i = 0; i < pending.size(); i++) {
+        if (d_reversal_thread) {
+          /* discovery started over and got as far as reversal again */
+          if (d_pending_packets.size() < MAX_PENDING_PACKETS) {
+            d_pending_packets.push_back(pending[i]);
+          }
+        }
+        else if (!d_piconet->have_clk27()) {
+          discover(pending[i]);
+        }
+      }
+    }
+
+    void
+    multi_hopper_impl::discover(classic_packet::sptr packet)
+    {
+      if (!d_piconet->have_clk6()) {
+        /* working on CLK1-6/UAP discovery */
+        d_piconet->UAP_from_header(packet);
+        if (d_piconet->have_clk6()) {
+          /* got CLK1-6/UAP, start working on CLK1-27 */
+          start_hop_reversal();
+        }
+      } else {
+        /* continue working on CLK1-27 */
+        /* we need timing information from an additional packet, so run through UAP_from_header() again */
+        d_piconet->UAP_from_header(packet);
+        if (d_piconet->have_clk6()) {
+          d_piconet->winnow();
+        }
+      }
     }
 
     int
@@ -78,61 +155,44 @@ namespace gr {
                             gr_vector_const_void_star &input_items,
                             gr_vector_void_star &output_items)
     {
-      int retval, latest_ac;
+      int retval;
       uint32_t clkn; /* native (local) clock in 625 us */
-      double freq;
-      char symbols[history()+40]; //poor estimate but safe
 
       clkn = (int) (d_cumulative_count / d_samples_per_slot) & 0x7ffffff;
 
-      if (d_piconet->have_clk27()) {
+      if (d_reversal_thread) {
+        finish_hop_reversal();
+      }
+
+      if (!d_reversal_thread && d_piconet->have_clk27()) {
         /* now that we know the clock and UAP, follow along and sniff each time slot on the correct channel */
-        hopalong(input_items, symbols, clkn, noutput_items);
+        /* only one channel is looked at per slot, so the first channel's scratch will do */
+        hopalong(input_items, scratch_symbols(0), clkn);
       } 
       else {
-        for (freq = d_low_freq; freq <= d_high_freq; freq += 1e6) {
-          gr_complex ch_samples[noutput_items];
-          gr_vector_void_star btch( 1 );
-          btch[0] = ch_samples;
-          double on_channel_energy, snr;
-          int ch_count = channel_samples( freq, input_items, btch, on_channel_energy, history() );
-          bool brok = check_snr( freq, on_channel_energy, snr, input_items );
-          if (brok) {
-            gr_vector_const_void_star cbtch( 1 );
-            cbtch[0] = ch_samples;
-            int num_symbols = channel_symbols( cbtch, symbols, ch_count );
-            
-            if (num_symbols >= SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) {
-              /* don't look beyond one slot for ACs */
-              latest_ac = ((num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
-                (num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
-              retval = classic_packet::sniff_ac(symbols, latest_ac);
-              if(retval > -1) {
-                classic_packet::sptr packet = classic_packet::make(
-                                                                   &symbols[retval], num_symbols - retval,
-                                                                   clkn, freq);
-                if (packet->get_LAP() == d_LAP && packet->header_present()) {
-                  if (!d_piconet->have_clk6()) {
-                    /* working on CLK1-6/UAP discovery */
-                    d_piconet->UAP_from_header(packet);
-                    if (d_piconet->have_clk6()) {
-                      /* got CLK1-6/UAP, start working on CLK1-27 */
-                      d_piconet->init_hop_reversal(d_aliased);
-                      /* use previously observed packets to eliminate candidates */
-                      d_piconet->winnow();
-                    }
-                  } else {
-                    /* continue working on CLK1-27 */
-                    /* we need timing information from an additional packet, so run through UAP_from_header() again */
-                    d_piconet->UAP_from_header(packet);
-                    if (!d_piconet->have_clk6()) {
-                      break;
-                    }
-                    d_piconet->winnow();
-                  }
-                  break;
+        /* channels found idle are skipped, so start from nothing found */
+        for (unsigned c = 0; c < d_scans.size( ); c++) {
+          d_scans[c].ac_index = -1;
+        }
+        for_each_channel( input_items, history( ), d_scan_channel );
+
+        /* piconet state is only touched here, in channel order */
+        for (unsigned c = 0; c < d_scans.size( ); c++) {
+          channel_scan& scan = d_scans[c];
+          retval = scan.ac_index;
+          if(retval > -1) {
+            classic_packet_view view(*scan.symbols, retval, scan.num_symbols - retval, scan.freq);
+            if (view.get_LAP() == d_LAP && view.header_present()) {
+              classic_packet::sptr packet = view.make(clkn);
+              if (d_reversal_thread) {
+                /* hop reversal is busy with the piconet */
+                if (d_pending_packets.size() < MAX_PENDING_PACKETS) {
+                  d_pending_packets.push_back(packet);
                 }
+              } else {
+                discover(packet);
               }
+              break;
             }
           }
         }
@@ -149,9 +209,39 @@ namespace gr {
       return (int) d_samples_per_slot;
     }
 
+    /* recover symbols and look for an AC on one channel, run in parallel */
+    void
+    multi_hopper_impl::scan_channel(gr_vector_const_void_star& input_items, int index, double freq)
+    {
+      channel_scan& scan = d_scans[index];
+      scan.freq = freq;
+      scan.num_symbols = 0;
+
+      channel_scratch& sc = d_scratch[index];
+      gr_complex *ch_samples = scratch_samples( index );
+      gr_vector_void_star& btch = sc.sample_out;
+      btch[0] = ch_samples;
+      double on_channel_energy, snr;
+      int ch_count = channel_samples( freq, input_items, btch, on_channel_energy, history() );
+      bool brok = check_snr( freq, on_channel_energy, snr, input_items );
+      if (brok) {
+        gr_vector_const_void_star& cbtch = sc.sample_in;
+        cbtch[0] = ch_samples;
+        scan.symbols = &scratch_symbols( index );
+        scan.num_symbols = channel_symbols( freq, cbtch, *scan.symbols, ch_count );
+            
+        if (scan.num_symbols >= SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) {
+          /* don't look beyond one slot for ACs */
+          int latest_ac = ((scan.num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
+            (scan.num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
+          scan.ac_index = classic_packet::sniff_ac(*scan.symbols, 0, latest_ac);
+        }
+      }
+    }
+
     void
     multi_hopper_impl::hopalong(gr_vector_const_void_star &input_items,
-                                char *symbols, uint32_t clkn, int noutput_items)
+                                symbol_buffer &symbols, uint32_t clkn)
     {
       int ac_index, latest_ac;
       uint32_t clock27 = (clkn + d_piconet->get_offset()) & 0x7ffffff;
@@ -161,25 +251,27 @@ namespace gr {
       else
         obs_freq = freq;
       if ((obs_freq >= d_low_freq) && (obs_freq <= d_high_freq)) {
-        gr_complex ch_samples[noutput_items];
-        gr_vector_void_star btch( 1 );
+        channel_scratch& sc = d_scratch[0];
+        gr_complex *ch_samples = scratch_samples( 0 );
+        gr_vector_void_star& btch = sc.sample_out;
         btch[0] = ch_samples;
         double on_channel_energy, snr;
         int ch_count = channel_samples( freq, input_items, btch, on_channel_energy, history() );
         bool brok = check_snr( freq, on_channel_energy, snr, input_items );
         if (brok) {
-          gr_vector_const_void_star cbtch( 1 );
+          gr_vector_const_void_star& cbtch = sc.sample_in;
           cbtch[0] = ch_samples;
-          int num_symbols = channel_symbols( cbtch, symbols, ch_count );
+          int num_symbols = channel_symbols( freq, cbtch, symbols, ch_count );
           if (num_symbols >= SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE ) {
             latest_ac = ((num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
               (num_symbols - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
-            ac_index = classic_packet::sniff_ac(symbols, latest_ac);
+            ac_index = classic_packet::sniff_ac(symbols, 0, latest_ac);
             if(ac_index > -1) {
-              classic_packet::sptr packet = classic_packet::make(&symbols[ac_index], num_symbols - ac_index, 0, obs_freq);
-              if(packet->get_LAP() == d_LAP) {
-                printf("clock 0x%07x, channel %2d: ", clock27, packet->get_channel( ));
-                if (packet->header_present()) {
+              classic_packet_view view(symbols, ac_index, num_symbols - ac_index, obs_freq);
+              if(view.get_LAP() == d_LAP) {
+                printf("clock 0x%07x, channel %2d: ", clock27, view.get_channel( ));
+                if (view.header_present()) {
+                  classic_packet::sptr packet = view.make(0);
                   packet->set_UAP(d_piconet->get_UAP());
                   packet->set_clock(clock27, true);
                   packet->decode();
@@ -197,7 +289,7 @@ namespace gr {
                 } else {
                   printf("ID\n");
                   if(d_tun) {
-                    int addr = (d_piconet->get_UAP() << 24) | packet->get_LAP();
+                    int addr = (d_piconet->get_UAP() << 24) | view.get_LAP();
                     write_interface(d_tunfd, NULL, 0, 0, addr, ETHER_TYPE);
                   }
                 }
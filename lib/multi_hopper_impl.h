@@ -29,6 +29,8 @@
 #include "gr_bluetooth/multi_hopper.h"
 #include "gr_bluetooth/piconet.h"
 #include "tun.h"
+#include <gnuradio/thread/thread.h>
+#include <vector>
 
 namespace gr {
   namespace bluetooth {
@@ -48,12 +50,51 @@ namespace gr {
 	/* the piconet we are monitoring */
         basic_rate_piconet::sptr d_piconet;
 
+	/*
+	 * hop reversal runs in the background, and the piconet is left
+	 * alone until it is done; packets turning up meanwhile wait here
+	 */
+	static const unsigned MAX_PENDING_PACKETS = 256;
+	gr::thread::thread             *d_reversal_thread;
+	gr::thread::mutex               d_reversal_mutex;
+	bool                            d_reversal_done;
+	std::vector<classic_packet::sptr> d_pending_packets;
+
+	/* start hop reversal for the piconet in the background */
+	void start_hop_reversal();
+
+	/* run in the background by start_hop_reversal() */
+	void run_hop_reversal();
+
+	/* if background hop reversal is done, catch up on pending packets */
+	void finish_hop_reversal();
+
+	/* use a packet from the piconet for UAP/clock discovery */
+	void discover(classic_packet::sptr packet);
+
 	/*
 	 * follow a piconet's hopping sequence and look for packets on the
 	 * appropriate channel for each time slot
 	 */
-	void hopalong(gr_vector_const_void_star &input_items, char *symbols,
-			uint32_t clkn, int noutput_items);
+	void hopalong(gr_vector_const_void_star &input_items, symbol_buffer &symbols,
+			uint32_t clkn);
+
+	/* what one channel turned up in the current time slot */
+	struct channel_scan {
+		double            freq;
+		symbol_buffer    *symbols;
+		int               num_symbols;
+		int               ac_index;
+	};
+
+	/* per channel results, indexed from d_low_freq */
+	std::vector<channel_scan> d_scans;
+
+	/* recover symbols and look for an AC on one channel, run in parallel */
+	void scan_channel(gr_vector_const_void_star& input_items, int index, double freq);
+
+	/* scan_channel() bound once for for_each_channel() */
+	channel_fn d_scan_channel;
 
 	/* Tun stuff */
 	int			d_tunfd;	// TUN fd
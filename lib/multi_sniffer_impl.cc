@@ -29,6 +29,7 @@
 
 #include <gnuradio/io_signature.h>
 #include "multi_sniffer_impl.h"
+#include <boost/bind.hpp>
 
 namespace gr {
   namespace bluetooth {
@@ -41,24 +42,31 @@ namespace gr {
 	  
     multi_sniffer::sptr
     multi_sniffer::make(double sample_rate, double center_freq,
-                        double squelch_threshold, bool tun)
+                        double squelch_threshold, bool tun,
+                        int queue_size, int queue_age)
     {
       return gnuradio::get_initial_sptr (new multi_sniffer_impl(sample_rate, center_freq, 
-                                                                squelch_threshold, tun));
+                                                                squelch_threshold, tun,
+                                                                queue_size, queue_age));
     }
 
     /*
      * The private constructor
      */
     multi_sniffer_impl::multi_sniffer_impl(double sample_rate, double center_freq,
-                                           double squelch_threshold, bool tun)
+                                           double squelch_threshold, bool tun,
+                                           int queue_size, int queue_age)
       : multi_block(sample_rate, center_freq, squelch_threshold),
         gr::sync_block ("bluetooth multi sniffer block",
                        gr::io_signature::make (1, 1, sizeof (gr_complex)),
                        gr::io_signature::make (0, 0, 0))
     {
       d_tun = tun;
+      d_queue_size = queue_size;
+      d_queue_age = (queue_age > 0) ? queue_age : 0;
       set_symbol_history(SYMBOLS_FOR_BASIC_RATE_HISTORY);
+      d_scans.resize(num_channels());
+      d_scan_channel = boost::bind(&multi_sniffer_impl::scan_channel, this, _1, _2, _3);
 
       /* Tun interface */
       if (d_tun) {
@@ -79,78 +87,100 @@ namespace gr {
     {
     }
 
-    int
-    multi_sniffer_impl::work( int                        noutput_items,
-                              gr_vector_const_void_star& input_items,
-                              gr_vector_void_star&       output_items )
+    /* recover symbols and find ACs/AAs on one channel, run in parallel */
+    void
+    multi_sniffer_impl::scan_channel( gr_vector_const_void_star& input_items,
+                                      int                        index,
+                                      double                     freq )
     {
-      for (double freq = d_low_freq; freq <= d_high_freq; freq += 1e6) {   
-        gr_complex *ch_samples = new gr_complex[noutput_items+100000];
-        gr_vector_void_star btch( 1 );
-        btch[0] = ch_samples;
-        double on_channel_energy, snr;
-        int ch_count = channel_samples( freq, input_items, btch, on_channel_energy, history() );
-        bool brok; // = check_basic_rate_squelch(input_items);
-        bool leok = brok = check_snr( freq, on_channel_energy, snr, input_items );
-
-        /* number of symbols available */
-        if (brok || leok) {
-          int sym_length = history();
-          char *symbols = new char[sym_length];
-          /* pointer to our starting place for sniff_ */
-          char *symp = symbols;
-          gr_vector_const_void_star cbtch( 1 );
-          cbtch[0] = ch_samples;
-          int len = channel_symbols( cbtch, symbols, ch_count );
-          delete [] ch_samples;
+      channel_scan& scan = d_scans[index];
+      scan.freq = freq;
+
+      channel_scratch& sc = d_scratch[index];
+      gr_complex *ch_samples = scratch_samples( index );
+      gr_vector_void_star& btch = sc.sample_out;
+      btch[0] = ch_samples;
+      double on_channel_energy;
+      int ch_count = channel_samples( freq, input_items, btch, on_channel_energy, history() );
+      bool brok; // = check_basic_rate_squelch(input_items);
+      bool leok = brok = check_snr( freq, on_channel_energy, scan.snr, input_items );
+
+      /* number of symbols available */
+      if (brok || leok) {
+        int sym_length = history();
+        symbol_buffer& symbols = scratch_symbols( index );
+        scan.symbols = &symbols;
+        /* offset of our starting place for sniff_ */
+        int pos = 0;
+        gr_vector_const_void_star& cbtch = sc.sample_in;
+        cbtch[0] = ch_samples;
+        int len = channel_symbols( freq, cbtch, symbols, ch_count );
           
-          if (brok) {
-            int limit = ((len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
-              (len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
+        if (brok) {
+          int limit = ((len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
+            (len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
         
-            /* look for multiple packets in this slot */
-            while (limit >= 0) {
-              /* index to start of packet */
-              int i = classic_packet::sniff_ac(symp, limit);
-              if (i >= 0) {
-                int step = i + SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE;
-                ac(&symp[i], len - i, freq, snr);
-                len   -= step;
-				if(step >= sym_length) error_out("Bad step");
-                symp   = &symp[step];
-                limit -= step;
-              } 
-              else {
-                break;
-              }
+          /* look for multiple packets in this slot */
+          while (limit >= 0) {
+            /* index to start of packet */
+            int i = classic_packet::sniff_ac(symbols, pos, limit);
+            if (i >= 0) {
+              int step = i + SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE;
+              scan.ac_hits.push_back( std::make_pair( pos + i, len - i ) );
+              len   -= step;
+              if(step >= sym_length) error_out("Bad step");
+              pos   += step;
+              limit -= step;
+            } 
+            else {
+              break;
             }
           }
+        }
 
-          if (leok) {
-            symp = symbols;
-            int limit = ((len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
-              (len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
-
-            while (limit >= 0) {
-              int i = le_packet::sniff_aa(symp, limit, freq);
-              if (i >= 0) {
-                int step = i + SYMBOLS_PER_LOW_ENERGY_PREAMBLE_AA;
-				//printf("symp[%i], len-i = %i\n", i, len-i);
-                aa(&symp[i], len - i, freq, snr);
-                len   -= step;
-				if(step >= sym_length) error_out("Bad step");
-                symp   = &symp[step];
-                limit -= step;
-              }
-              else {
-                break;
-              }
+        if (leok) {
+          pos = 0;
+          int limit = ((len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) < SYMBOLS_PER_BASIC_RATE_SLOT) ? 
+            (len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) : SYMBOLS_PER_BASIC_RATE_SLOT;
+
+          while (limit >= 0) {
+            int i = le_packet::sniff_aa(symbols, pos, limit, freq, d_connection_aas);
+            if (i >= 0) {
+              int step = i + SYMBOLS_PER_LOW_ENERGY_PREAMBLE_AA;
+              scan.aa_hits.push_back( std::make_pair( pos + i, len - i ) );
+              len   -= step;
+              if(step >= sym_length) error_out("Bad step");
+              pos   += step;
+              limit -= step;
+            }
+            else {
+              break;
             }
           }
-          delete [] symbols;
         }
-        else {
-          delete [] ch_samples;
+      }
+    }
+
+    int
+    multi_sniffer_impl::work( int                        noutput_items,
+                              gr_vector_const_void_star& input_items,
+                              gr_vector_void_star&       output_items )
+    {
+      /* channels found idle are skipped, so start from nothing found */
+      for (unsigned c = 0; c < d_scans.size( ); c++) {
+        d_scans[c].ac_hits.clear( );
+        d_scans[c].aa_hits.clear( );
+      }
+      for_each_channel( input_items, history( ), d_scan_channel );
+
+      /* piconet state is only touched here, in channel then time order */
+      for (unsigned c = 0; c < d_scans.size( ); c++) {
+        channel_scan& scan = d_scans[c];
+        for (unsigned h = 0; h < scan.ac_hits.size( ); h++) {
+          ac(*scan.symbols, scan.ac_hits[h].first, scan.ac_hits[h].second, scan.freq, scan.snr);
+        }
+        for (unsigned h = 0; h < scan.aa_hits.size( ); h++) {
+          aa(*scan.symbols, scan.aa_hits[h].first, scan.aa_hits[h].second, scan.freq, scan.snr);
         }
       }
       d_cumulative_count += (int) d_samples_per_slot;
@@ -167,19 +197,22 @@ namespace gr {
 
     /* handle AC */
     void 
-    multi_sniffer_impl::ac(char *symbols, int len, double freq, double snr)
+    multi_sniffer_impl::ac(const symbol_buffer& symbols, int offset, int len, double freq, double snr)
     {
       /* native (local) clock in 625 us */	
       uint32_t clkn = (int) (d_cumulative_count / d_samples_per_slot) & 0x7ffffff;
-      classic_packet::sptr pkt = classic_packet::make(symbols, len, clkn, freq);
-      uint32_t lap = pkt->get_LAP();
+      classic_packet_view view(symbols, offset, len, freq);
+      uint32_t lap = view.get_LAP();
 
       printf("time %6d, snr=%.1f, channel %2d, LAP %06x ", 
-             clkn, snr, pkt->get_channel( ), lap);
+             clkn, snr, view.get_channel( ), lap);
 
-      if (pkt->header_present()) {
+      /* only copy the symbols out for packets with a header */
+      if (view.header_present()) {
+        classic_packet::sptr pkt = view.make(clkn);
         if (!d_basic_rate_piconets[lap]) {
           d_basic_rate_piconets[lap] = basic_rate_piconet::make(lap);
+          d_basic_rate_piconets[lap]->set_queue_limits(d_queue_size, d_queue_age);
         }
         basic_rate_piconet::sptr pn = d_basic_rate_piconets[lap];
 
@@ -205,23 +238,43 @@ namespace gr {
 
     /* handle AA */
     void
-    multi_sniffer_impl::aa(char *symbols, int len, double freq, double snr)
+    multi_sniffer_impl::aa(const symbol_buffer& symbols, int offset, int len, double freq, double snr)
     {
-      le_packet::sptr pkt = le_packet::make(symbols, len, freq);
+      le_packet::sptr pkt = le_packet::make(symbols, offset, len, freq);
       uint32_t clkn = (int) (d_cumulative_count / d_samples_per_slot) & 0x7ffffff;
+      uint32_t aa = pkt->get_AA( );
+
+      /* data channel CRCs can only be checked once CONNECT_REQ gave CRCInit */
+      if (!pkt->is_advertising()) {
+        std::map<uint32_t, low_energy_piconet::sptr>::iterator it = d_low_energy_piconets.find(aa);
+        if ((it == d_low_energy_piconets.end()) || !it->second->have_crc_init()) {
+          return;
+        }
+        pkt->set_crc_init(it->second->get_crc_init());
+      }
+
+      /* anything failing its CRC is noise, or too damaged to use */
+      pkt->decode();
+      if (!pkt->got_payload()) {
+        return;
+      }
 
       printf("time %6d, snr=%.1f, ", clkn, snr);
       pkt->print( );
 
-      if (pkt->header_present()) {
-        uint32_t aa = pkt->get_AA( );
+      /* follow the connection a CONNECT_REQ sets up, until it ends */
+      uint32_t crc_init;
+      if (pkt->connect_req(aa, crc_init)) {
         if (!d_low_energy_piconets[aa]) {
           d_low_energy_piconets[aa] = low_energy_piconet::make(aa);
+          d_low_energy_piconets[aa]->set_queue_limits(d_queue_size, d_queue_age);
         }
-        low_energy_piconet::sptr pn = d_low_energy_piconets[aa];
+        d_low_energy_piconets[aa]->set_crc_init(crc_init);
+        d_connection_aas.insert(aa);
       }
-      else {
-        // TODO: log AA
+      else if (pkt->terminate_ind()) {
+        d_low_energy_piconets.erase(aa);
+        d_connection_aas.erase(aa);
       }
     }
 
@@ -290,7 +343,7 @@ namespace gr {
       printf("working on UAP/CLK1-6\n");
 
       /* store packet for decoding after discovery is complete */
-      pn->enqueue(pkt);
+      pn->enqueue(pkt, pkt->d_clkn);
 
       if (pn->UAP_from_header(pkt))
         /* success! decode the stored packets */
@@ -306,6 +359,10 @@ namespace gr {
     {
       packet::sptr pkt;
       printf("Decoding queued packets\n");
+      if (pn->queue_overflows() || pn->queue_expired()) {
+        printf("%lu packets dropped from a full queue, %lu too old\n",
+               pn->queue_overflows(), pn->queue_expired());
+      }
       
       while (pkt = pn->dequeue()) {
         classic_packet::sptr cpkt = boost::dynamic_pointer_cast<classic_packet>(pkt);
@@ -354,6 +411,7 @@ namespace gr {
       /* make use of this information from now on */
       if (!d_basic_rate_piconets[lap]) {
         d_basic_rate_piconets[lap] = basic_rate_piconet::make(lap);
+        d_basic_rate_piconets[lap]->set_queue_limits(d_queue_size, d_queue_age);
       }
       pn = d_basic_rate_piconets[lap];
 	
@@ -31,6 +31,7 @@
 #include "gr_bluetooth/piconet.h"
 #include "tun.h"
 #include <map>
+#include <vector>
 
 namespace gr {
   namespace bluetooth {
@@ -51,15 +52,42 @@ namespace gr {
       unsigned char d_ether_addr[ETH_ALEN];
       static const unsigned short ETHER_TYPE = 0xFFF0;
 
+      /* queue limits handed to each new piconet */
+      int d_queue_size;
+      uint32_t d_queue_age;
+
       /* the piconets we are monitoring */
       std::map<int, basic_rate_piconet::sptr> d_basic_rate_piconets;
       std::map<uint32_t, low_energy_piconet::sptr> d_low_energy_piconets;
 
-      /* handle AC */
-      void ac(char *symbols, int len, double freq, double snr);
+      /* AAs of the LE connections seen set up and not yet ended */
+      access_address_set d_connection_aas;
+
+      /* what one channel turned up in the current time slot */
+      struct channel_scan {
+        double            freq;
+        double            snr;
+        symbol_buffer    *symbols;
+
+        /* symbol offset and remaining length of each AC and AA found */
+        std::vector<std::pair<int, int> > ac_hits;
+        std::vector<std::pair<int, int> > aa_hits;
+      };
+
+      /* per channel results, indexed from d_low_freq */
+      std::vector<channel_scan> d_scans;
+
+      /* recover symbols and find ACs/AAs on one channel, run in parallel */
+      void scan_channel(gr_vector_const_void_star& input_items, int index, double freq);
+
+      /* scan_channel() bound once for for_each_channel() */
+      channel_fn d_scan_channel;
+
+      /* handle AC found at offset */
+      void ac(const symbol_buffer& symbols, int offset, int len, double freq, double snr);
 
-      /* handle AA */
-      void aa(char *symbols, int len, double freq, double snr);
+      /* handle AA found at offset */
+      void aa(const symbol_buffer& symbols, int offset, int len, double freq, double snr);
 
       /* handle ID packet (no header) */
       void id(uint32_t lap);
@@ -81,7 +109,8 @@ namespace gr {
       void fhs(classic_packet::sptr pkt);
 
     public:
-      multi_sniffer_impl(double sample_rate, double center_freq, double squelch_threshold, bool tun);
+      multi_sniffer_impl(double sample_rate, double center_freq, double squelch_threshold, bool tun,
+                         int queue_size, int queue_age);
       ~multi_sniffer_impl();
 
       // Where all the action really happens
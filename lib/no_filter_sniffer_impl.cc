@@ -33,15 +33,18 @@
 namespace gr {
 namespace bluetooth {
 
-    no_filter_sniffer::sptr no_filter_sniffer::make(double sample_rate, double center_freq)
+    no_filter_sniffer::sptr no_filter_sniffer::make(double sample_rate, double center_freq,
+                                                    int queue_size, int queue_age)
     {
-        return gnuradio::get_initial_sptr (new no_filter_sniffer_impl(sample_rate, center_freq));
+        return gnuradio::get_initial_sptr (new no_filter_sniffer_impl(sample_rate, center_freq,
+                                                                      queue_size, queue_age));
     }
 
     /*
      * The private constructor
      */
-    no_filter_sniffer_impl::no_filter_sniffer_impl(double sample_rate, double center_freq)
+    no_filter_sniffer_impl::no_filter_sniffer_impl(double sample_rate, double center_freq,
+                                                   int queue_size, int queue_age)
         : gr::sync_block ("bluetooth no filter sniffer block",
                 gr::io_signature::make (1, 1, sizeof (int8_t)),
                 gr::io_signature::make (0, 0, 0))
@@ -52,6 +55,8 @@ namespace bluetooth {
         d_channel_freq = BASE_FREQUENCY + (d_channel * CHANNEL_WIDTH);
 
         d_cumulative_count = 0;
+        d_queue_size = queue_size;
+        d_queue_age = (queue_age > 0) ? queue_age : 0;
 
         /* we want to have 5 slots (max packet length) available in the history */
         set_history((sample_rate/SYMBOL_RATE)*SYMBOLS_FOR_BASIC_RATE_HISTORY);
@@ -70,16 +75,19 @@ namespace bluetooth {
     {
         char* in = (char*) input_items[0];
         int len = history()+noutput_items-1;
+        d_symbols.pack(in, len);
+        /* start positions with the whole access code in the input */
+        int limit = len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE + 1;
         /* index to start of packet */
-        int offset = classic_packet::sniff_ac(in, len);
+        int offset = classic_packet::sniff_ac(d_symbols, 0, limit);
         int items_consumed = 0;
         if (offset>=0) {
-            ac(&in[offset], len-offset, d_channel_freq, offset);
+            ac(d_symbols, offset, len-offset, d_channel_freq);
             items_consumed = offset + SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE;
         }
-        /* no AC in the whole range of limit */
+        /* no AC in the whole range of limit, but one may start in the tail */
         else {
-            items_consumed = len;
+            items_consumed = limit;
         }
         d_cumulative_count += (int) items_consumed;
         /* 
@@ -93,21 +101,24 @@ namespace bluetooth {
     }
 
     /* handle AC */
-    void no_filter_sniffer_impl::ac(char *symbols, int max_len, double freq, int offset)
+    void no_filter_sniffer_impl::ac(const symbol_buffer& symbols, int offset, int max_len, double freq)
     {
         /* native (local) clock in 625 us */	
         uint32_t clkn = (int) ((d_cumulative_count+offset-history()) / 625) & 0x7ffffff;
         /* same clock in ms */
         double time_ms = ((double) d_cumulative_count+offset-history())/1000;
-        classic_packet::sptr pkt = classic_packet::make(symbols, max_len, clkn, freq);
-        uint32_t lap = pkt->get_LAP();
+        classic_packet_view view(symbols, offset, max_len, freq);
+        uint32_t lap = view.get_LAP();
 
         printf("time %6d (%6.1f ms), channel %2d, LAP %06x ", 
-                clkn, time_ms, pkt->get_channel( ), lap);
+                clkn, time_ms, view.get_channel( ), lap);
 
-        if (pkt->header_present()) {
+        /* only copy the symbols out for packets with a header */
+        if (view.header_present()) {
+            classic_packet::sptr pkt = view.make(clkn);
             if (!d_basic_rate_piconets[lap]) {
                 d_basic_rate_piconets[lap] = basic_rate_piconet::make(lap);
+                d_basic_rate_piconets[lap]->set_queue_limits(d_queue_size, d_queue_age);
             }
             basic_rate_piconet::sptr pn = d_basic_rate_piconets[lap];
 
@@ -172,7 +183,7 @@ namespace bluetooth {
         printf("working on UAP/CLK1-6\n");
 
         /* store packet for decoding after discovery is complete */
-        pn->enqueue(pkt);
+        pn->enqueue(pkt, pkt->d_clkn);
 
         if (pn->UAP_from_header(pkt))
             /* success! decode the stored packets */
@@ -184,6 +195,10 @@ namespace bluetooth {
     {
         packet::sptr pkt;
         printf("Decoding queued packets\n");
+        if (pn->queue_overflows() || pn->queue_expired()) {
+            printf("%lu packets dropped from a full queue, %lu too old\n",
+                    pn->queue_overflows(), pn->queue_expired());
+        }
 
         while (pkt = pn->dequeue()) {
             classic_packet::sptr cpkt = boost::dynamic_pointer_cast<classic_packet>(pkt);
@@ -229,6 +244,7 @@ namespace bluetooth {
         /* make use of this information from now on */
         if (!d_basic_rate_piconets[lap]) {
             d_basic_rate_piconets[lap] = basic_rate_piconet::make(lap);
+            d_basic_rate_piconets[lap]->set_queue_limits(d_queue_size, d_queue_age);
         }
         pn = d_basic_rate_piconets[lap];
 
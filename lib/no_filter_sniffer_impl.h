@@ -66,8 +66,15 @@ namespace bluetooth {
             /* the piconets we are monitoring */
             std::map<int, basic_rate_piconet::sptr> d_basic_rate_piconets;
 
-            /* handle AC */
-            void ac(char *symbols, int max_len, double freq, int offset);
+            /* queue limits handed to each new piconet */
+            int d_queue_size;
+            uint32_t d_queue_age;
+
+            /* input symbols, packed */
+            symbol_buffer d_symbols;
+
+            /* handle AC found at offset */
+            void ac(const symbol_buffer& symbols, int offset, int max_len, double freq);
 
             /* handle ID packet (no header) */
             void id(uint32_t lap);
@@ -86,7 +93,8 @@ namespace bluetooth {
             void fhs(classic_packet::sptr pkt);
 
         public:
-            no_filter_sniffer_impl(double sample_rate, double center_freq);
+            no_filter_sniffer_impl(double sample_rate, double center_freq,
+                                   int queue_size, int queue_age);
             ~no_filter_sniffer_impl();
 
             // Where all the action really happens
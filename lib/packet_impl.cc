@@ -29,6 +29,7 @@
 
 #include <gnuradio/io_signature.h>
 #include "packet_impl.h"
+#include "packet_pool.h"
 #include <stdio.h>
 #include <string.h>
 #include <iostream>
@@ -38,7 +39,7 @@ namespace gr {
 
     // -------------------------------------------------------------------
 
-    packet::packet(char *stream, int length, double freq) :
+    packet::packet(const symbol_buffer& stream, int offset, int length, double freq) :
       d_format( UNKNOWN ),
       d_freq( freq ),
       d_length( 0 ),
@@ -49,15 +50,42 @@ namespace gr {
       d_whitened( false ),
       d_have_payload( false )
     {
+      reset(stream, offset, length, freq);
+    }
+
+    void packet::reset(const symbol_buffer& stream, int offset, int length, double freq)
+    {
+      d_format         = UNKNOWN;
+      d_freq           = freq;
+      d_packet_type    = 0;
+      d_payload_length = 0;
+      d_whitened       = false;
+      d_have_payload   = false;
+      d_payload.clear();
+
       if(length > MAX_SYMBOLS) {
         length = MAX_SYMBOLS;
       }
-      for(int i = 0; i < length; i++) {
-        d_symbols[i] = stream[i];
-      }
+      /*
+       * zero filled past length, decoders may read well beyond it; packed
+       * that is only 400 bytes, and a recycled packet has the room already
+       */
+      d_symbols.assign(stream, offset, length);
+      d_symbols.resize(MAX_SYMBOLS);
       d_length = length;
     }
 
+    char *packet::payload_bits(int bits)
+    {
+      if ((int) d_payload.size() < bits) {
+        d_payload.resize(bits);
+      }
+      if (d_payload.empty()) {
+        d_payload.resize(1);
+      }
+      return &d_payload[0];
+    }
+
     bool packet::get_whitened()
     {
       return d_whitened;
@@ -89,6 +117,44 @@ namespace gr {
       1, 1, 1, 0, 1, 1, 1, 0, 0, 0, 0, 1, 1, 1, 1
     };
 
+    /*
+     * WHITENING_DATA repeated, packed like a symbol_buffer, long enough
+     * that the whitening for any packet can be read straight from where
+     * its clock (classic) or channel (LE) starts it.  Each of those
+     * phases is just an offset into the one stream.
+     */
+    struct whitening_stream {
+      /* any phase, an 18 bit header skip, 3125 (MAX_SYMBOLS) and a read */
+      static const int BITS = 127 + 18 + 3125 + 64;
+      uint64_t words[BITS / 64 + 2];
+
+      whitening_stream()
+      {
+        memset(words, 0, sizeof(words));
+        for (int count = 0; count < BITS; count++)
+          words[count / 64] |= (uint64_t) packet::WHITENING_DATA[count % 127] << (count % 64);
+      }
+    };
+
+    static const whitening_stream WHITENING_STREAM;
+
+    /*
+     * n (<= 64) whitening bits from index, the first in the LSB.  index
+     * may run past 127 by as much as a packet's length: start it from
+     * the phase, below 127, and add the number of bits already used.
+     */
+    static inline uint64_t
+    whitening_bits(unsigned index, int n)
+    {
+      int word = index >> 6;
+      int shift = index & 63;
+      uint64_t bits = WHITENING_STREAM.words[word] >> shift;
+      if (shift) {
+        bits |= WHITENING_STREAM.words[word + 1] << (64 - shift);
+      }
+      return (n < 64) ? (bits & ((UINT64_C(1) << n) - 1)) : bits;
+    }
+
     /* Convert from normal bytes to one-LSB-per-byte format */
     void packet::convert_to_grformat(uint8_t input, uint8_t *output)
     {
@@ -146,17 +212,24 @@ namespace gr {
     }
 
     int packet::sniff_packet(char *stream, int stream_length, double freq, air_format& fmt)
+    {
+      symbol_buffer symbols(stream, stream_length + classic_packet::SYMBOLS_PER_BASIC_RATE_ACCESS_CODE - 1);
+      return sniff_packet(symbols, 0, stream_length, freq, fmt);
+    }
+
+    int packet::sniff_packet(const symbol_buffer& stream, int offset, int stream_length,
+                             double freq, air_format& fmt)
     {
       int retval = -1;
 
       if ((retval == -1) && ((fmt == UNKNOWN) || (fmt == CLASSIC))) {
-        retval = classic_packet::sniff_ac(stream, stream_length);
+        retval = classic_packet::sniff_ac(stream, offset, stream_length);
         if (retval >= 0) {
           fmt = CLASSIC;
         }
       }
       if ((retval == -1) && ((fmt == UNKNOWN) || (fmt == LOW_ENERGY))) {
-        retval = le_packet::sniff_aa(stream, stream_length, freq);
+        retval = le_packet::sniff_aa(stream, offset, stream_length, freq);
         if (retval >= 0) {
           fmt = LOW_ENERGY;
         }
@@ -205,35 +278,104 @@ namespace gr {
     classic_packet::sptr
     classic_packet::make(char *stream, int length)
     {
-      return classic_packet::sptr(new classic_packet_impl(stream, length));
+      symbol_buffer symbols(stream, length);
+      return make(symbols, 0, length);
     }
 
     classic_packet::sptr
     classic_packet::make(char *stream, int length, uint32_t clkn, double freq)
     {
-      classic_packet::sptr pkt = classic_packet::sptr(new classic_packet_impl(stream, length));
+      symbol_buffer symbols(stream, length);
+      return make(symbols, 0, length, clkn, freq);
+    }
+
+    classic_packet::sptr
+    classic_packet::make(const symbol_buffer& stream, int offset, int length)
+    {
+      classic_packet::sptr pkt =
+        packet_pool<classic_packet_impl>::instance().make<classic_packet::sptr>(stream, offset, length);
+
+      /* CLKN and channel unknown */
+      pkt->d_clkn = 0;
+      pkt->d_channel = -1;
+
+      return pkt;
+    }
+
+    classic_packet::sptr
+    classic_packet::make(const symbol_buffer& stream, int offset, int length,
+                         uint32_t clkn, double freq)
+    {
+      classic_packet::sptr pkt =
+        packet_pool<classic_packet_impl>::instance().make<classic_packet::sptr>(stream, offset, length, freq);
 
       pkt->d_clkn = clkn;
-      pkt->d_freq = freq;
+      pkt->d_channel = freq2chan(freq);
+
+      return pkt;
+    }
 
+    int classic_packet::freq2chan(const double freq)
+    {
       if ((freq >= 2402000000.0) && (freq <= 2480000000.0)) {
-        pkt->d_channel = (int) ((freq-2402000000.0)/1000000.0);
-      }
-      else {
-        pkt->d_channel = -1;
+        return (int) ((freq-2402000000.0)/1000000.0);
       }
+      return -1;
+    }
 
-      return pkt;
+    classic_packet_view::classic_packet_view(const symbol_buffer& stream, int offset, int length,
+                                             double freq)
+      : d_stream(stream),
+        d_offset(offset),
+        d_length(length),
+        d_freq(freq)
+    {
+    }
+
+    uint32_t classic_packet_view::get_LAP() const
+    {
+      return d_stream.bits(d_offset + 38, 24);
+    }
+
+    int classic_packet_view::get_channel() const
+    {
+      return classic_packet::freq2chan(d_freq);
+    }
+
+    bool classic_packet_view::header_present() const
+    {
+      return classic_packet::header_present(d_stream, d_offset, d_length);
+    }
+
+    classic_packet::sptr classic_packet_view::make(uint32_t clkn) const
+    {
+      return classic_packet::make(d_stream, d_offset, d_length, clkn, d_freq);
     }
 
     /*
      * The private constructor
      */
-    classic_packet_impl::classic_packet_impl(char *stream, int length)
-      : packet(stream, length)
+    classic_packet_impl::classic_packet_impl(const symbol_buffer& stream, int offset, int length,
+                                             double freq)
+      : packet(stream, offset, length, freq)
+    {
+      start();
+    }
+
+    void classic_packet_impl::reset(const symbol_buffer& stream, int offset, int length, double freq)
+    {
+      packet::reset(stream, offset, length, freq);
+      start();
+    }
+
+    /* a recycled packet must not keep anything of the one before */
+    void classic_packet_impl::start()
     {
       //FIXME maybe should verify LAP
-      d_LAP            = air_to_host32(&d_symbols[38], 24);
+      d_LAP            = d_symbols.bits(38, 24);
+      d_UAP            = 0;
+      d_NAP            = 0;
+      d_clock          = 0;
       d_whitened       = true;
       d_have_UAP       = false;
       d_have_NAP       = false;
@@ -241,29 +383,153 @@ namespace gr {
       d_have_clk27     = false;
       d_have_payload   = false;
       d_payload_length = 0;
+      d_payload_header_length = -1;
+      d_payload_llid   = 0;
+      d_payload_flow   = 0;
+      d_fec23_base     = 0;
+      d_fec23_count    = 0;
+      memset(d_packet_header, 0, sizeof(d_packet_header));
+      memset(d_payload_header, 0, sizeof(d_payload_header));
     }
 
     /* search a symbol stream to find a classic_packet, return index */
     int classic_packet::sniff_ac(char *stream, int stream_length)
     {
-      /* Looks for an AC in the stream */
+      /* a match at stream_length - 1 reads the rest of an access code past it */
+      symbol_buffer symbols(stream, stream_length + SYMBOLS_PER_BASIC_RATE_ACCESS_CODE - 1);
+      return sniff_ac(symbols, 0, stream_length);
+    }
+
+    /* the first 68 symbols of an acgen() AC, in air order with the first in the LSB */
+    static void pack_ac(const uint8_t *ac, uint64_t& head, uint64_t& tail)
+    {
       int count;
-      int max_distance = 2; // maximum number of bit errors to tolerate in preamble + trailer
 
-      for( count=0; count<stream_length; count++ ) {
-        char * symbols = &stream[count];
-        // start of sync word (includes LSB of sync word)
-        uint8_t preamble = air_to_host8( &symbols[0], 5 );
-        // MSB of LAP and 6-bit barker in 7 symbols
-        uint16_t barker = air_to_host16( &symbols[61], 7 );
-        if ((PREAMBLE_DISTANCE[preamble] + BARKER_DISTANCE[barker]) 
-            <= max_distance) {
-          uint32_t LAP = air_to_host32( &symbols[38], 24 );
-          if (check_ac( symbols, LAP )) {
-            return count;
+      head = tail = 0;
+      for(count = 0; count < 64; count++)
+        head |= (uint64_t) ((ac[count/8] >> (7 - count%8)) & 1) << count;
+      for(count = 64; count < classic_packet::SYMBOLS_PER_BASIC_RATE_ACCESS_CODE; count++)
+        tail |= (uint64_t) ((ac[count/8] >> (7 - count%8)) & 1) << (count - 64);
+    }
+
+    /*
+     * Every bit of the access code is the AC of LAP 0 XORed with some
+     * of the LAP bits, so the packed AC of any LAP is the XOR of one
+     * entry per LAP byte, each holding that byte's contribution.
+     */
+    struct access_code_tables {
+      uint64_t head0, tail0;
+      uint64_t head[3][256];
+      uint64_t tail[3][256];
+
+      access_code_tables()
+      {
+        uint8_t ac[9];
+        classic_packet::acgen(0, ac);
+        pack_ac(ac, head0, tail0);
+        for (int byte = 0; byte < 3; byte++) {
+          for (int value = 0; value < 256; value++) {
+            classic_packet::acgen(value << (8 * byte), ac);
+            pack_ac(ac, head[byte][value], tail[byte][value]);
+            head[byte][value] ^= head0;
+            tail[byte][value] ^= tail0;
           }
         }
       }
+    };
+
+    /*
+     * Built while the library loads, so every block that searches for
+     * ACs (sniffers, hopper, no-filter sniffer) shares one copy that is
+     * read-only by the time any work() runs, with no first-use guard.
+     */
+    static const access_code_tables AC_TABLES;
+
+    /* symbol errors between the AC of LAP and the one at pos in stream */
+    static inline int ac_errors(const access_code_tables& t, const symbol_buffer& stream,
+                                int pos, int LAP)
+    {
+      int b0 = LAP & 0xff, b1 = (LAP >> 8) & 0xff, b2 = (LAP >> 16) & 0xff;
+      uint64_t head = t.head0 ^ t.head[0][b0] ^ t.head[1][b1] ^ t.head[2][b2];
+      uint64_t tail = t.tail0 ^ t.tail[0][b0] ^ t.tail[1][b1] ^ t.tail[2][b2];
+
+      return stream.distance(pos, head, 64) +
+        stream.distance(pos + 64, tail, classic_packet::SYMBOLS_PER_BASIC_RATE_ACCESS_CODE - 64);
+    }
+
+    /* preamble (with the sync word LSB) and barker (with the LAP MSB), air order */
+    static const uint64_t AC_PREAMBLE = 0x0a;
+    static const uint64_t AC_BARKER   = 0x27;
+
+    /*
+     * Bit-sliced error counter for 64 lanes at once: bit j of le[n] stays
+     * set while lane j has seen at most n mismatches among the words
+     * added so far.
+     */
+    struct lane_errors {
+      uint64_t le[3];
+
+      lane_errors() { le[0] = le[1] = le[2] = ~UINT64_C(0); }
+
+      void add(uint64_t mismatch)
+      {
+        le[2] = (le[2] & ~mismatch) | (le[1] & mismatch);
+        le[1] = (le[1] & ~mismatch) | (le[0] & mismatch);
+        le[0] &= ~mismatch;
+      }
+    };
+
+    int classic_packet::sniff_ac(const symbol_buffer& stream, int offset, int stream_length)
+    {
+      /*
+       * Looks for an AC in the stream, 64 candidate positions at a time.
+       * Reading 64 symbols from position base + i gives, in lane j, the
+       * i'th symbol of an AC starting at base + j, so each of the 12
+       * preamble and barker symbols is one word compared against all 64
+       * positions.  Either polarity of each is allowed, with up to 2
+       * symbol errors over both together: the same test as summing
+       * PREAMBLE_DISTANCE and BARKER_DISTANCE one position at a time.
+       */
+      int count, i;
+
+      for( count=0; count<stream_length; count+=64 ) {
+        int base = offset + count;
+        int remaining = stream_length - count;
+        uint64_t lanes = (remaining < 64) ? ((UINT64_C(1) << remaining) - 1) : ~UINT64_C(0);
+        lane_errors preamble[2], barker[2];
+
+        for( i=0; i<5; i++ ) {
+          uint64_t w = stream.bits( base + i, 64 );
+          uint64_t mismatch = ((AC_PREAMBLE >> i) & 1) ? ~w : w;
+          preamble[0].add( mismatch );
+          preamble[1].add( ~mismatch );
+        }
+        for( i=0; i<7; i++ ) {
+          uint64_t w = stream.bits( base + 61 + i, 64 );
+          uint64_t mismatch = ((AC_BARKER >> i) & 1) ? ~w : w;
+          barker[0].add( mismatch );
+          barker[1].add( ~mismatch );
+        }
+
+        /* preamble errors + barker errors <= 2 */
+        uint64_t p0 = preamble[0].le[0] | preamble[1].le[0];
+        uint64_t p1 = preamble[0].le[1] | preamble[1].le[1];
+        uint64_t b0 = barker[0].le[0] | barker[1].le[0];
+        uint64_t b1 = barker[0].le[1] | barker[1].le[1];
+        uint64_t b2 = barker[0].le[2] | barker[1].le[2];
+        uint64_t candidates = (b0 | (b1 & p1) | (b2 & p0)) & lanes;
+
+        while (candidates) {
+          int lane = __builtin_ctzll( candidates );
+          int pos = base + lane;
+          uint32_t LAP = stream.bits( pos + 38, 24 );
+          /* same test as check_ac() */
+          if (ac_errors( AC_TABLES, stream, pos, LAP ) < 7) {
+            return count + lane;
+          }
+          candidates &= candidates - 1;
+        }
+      }
       return -1;
     }
 
@@ -307,76 +573,91 @@ namespace gr {
 
     /* Generate Access Code from an LAP */
     uint8_t *classic_packet::acgen(int LAP)
+    {
+      uint8_t *retval = (uint8_t *) malloc(9);
+      acgen(LAP, retval);
+      return retval;
+    }
+
+    /* Generate Access Code from an LAP into ac[9], without allocating */
+    void classic_packet::acgen(int LAP, uint8_t *ac)
     {
       /* Endianness - Assume LAP is MSB first, rest done LSB first */
-      uint8_t *retval, count, *cw, *data;
-      retval = (uint8_t *) calloc(9,1);
-      data = (uint8_t *) malloc(30);
+      int count;
+      uint32_t data;
+      uint64_t cw;
       // pseudo-random sequence to XOR with LAP and syncword
-      uint8_t pn[] = {0x03,0xF2,0xA3,0x3D,0xD6,0x9B,0x12,0x1C,0x10};
-      // generator polynomial for the access code
-      uint8_t g[] = {1,0,0,1,0,1,0,1,1,0,1,1,1,1,0,0,1,0,0,0,1,1,1,0,1,0,1,0,0,0,0,1,1,0,1};
+      static const uint8_t pn[] = {0x03,0xF2,0xA3,0x3D,0xD6,0x9B,0x12,0x1C,0x10};
+      // generator polynomial for the access code, g[0] in the LSB
+      static const uint64_t g = UINT64_C(0x585713da9);
+      static const uint64_t cw_mask = (UINT64_C(1) << 34) - 1;
 
       LAP = reverse((LAP & 0xff0000)>>16) | (reverse((LAP & 0x00ff00)>>8)<<8) | (reverse(LAP & 0x0000ff)<<16);
 
-      retval[4] = (LAP & 0xc00000)>>22;
-      retval[5] = (LAP & 0x3fc000)>>14;
-      retval[6] = (LAP & 0x003fc0)>>6;
-      retval[7] = (LAP & 0x00003f)<<2;
+      memset(ac, 0, 9);
+      ac[4] = (LAP & 0xc00000)>>22;
+      ac[5] = (LAP & 0x3fc000)>>14;
+      ac[6] = (LAP & 0x003fc0)>>6;
+      ac[7] = (LAP & 0x00003f)<<2;
 
       /* Trailer */
-      if(LAP & 0x1)
-	{	retval[7] |= 0x03;
-          retval[8] = 0x2a;
-	} else
-        retval[8] = 0xd5;
+      if(LAP & 0x1) {
+        ac[7] |= 0x03;
+        ac[8] = 0x2a;
+      } else
+        ac[8] = 0xd5;
 
       for(count = 4; count < 9; count++)
-        retval[count] ^= pn[count];
+        ac[count] ^= pn[count];
 
-      data[0] = (retval[4] & 0x02) >> 1;
-      data[1] = (retval[4] & 0x01);
-      host_to_air(reverse(retval[5]), (char *) data+2, 8);
-      host_to_air(reverse(retval[6]), (char *) data+10, 8);
-      host_to_air(reverse(retval[7]), (char *) data+18, 8);
-      host_to_air(reverse(retval[8]), (char *) data+26, 4);
+      /* the 30 information bits, lfsr()'s data[0] in the MSB */
+      data = ((uint32_t) (ac[4] & 0x03) << 28) | ((uint32_t) ac[5] << 20) |
+        ((uint32_t) ac[6] << 12) | ((uint32_t) ac[7] << 4) | (ac[8] >> 4);
 
-      cw = lfsr(data, 64, 30, g);
-      free(data);
+      /* the same register lfsr(data, 64, 30, g) runs, with cw[j] in bit j */
+      cw = 0;
+      for (count = 29; count >= 0; count--) {
+        uint64_t feedback = ((data >> (29 - count)) ^ (cw >> 33)) & 1;
+        cw = ((cw << 1) & cw_mask) ^ (feedback ? (g & cw_mask) : 0);
+      }
 
-      retval[0] = cw[0] << 3 | cw[1] << 2 | cw[2] << 1 | cw[3];
-      retval[1] = cw[4] << 7 | cw[5] << 6 | cw[6] << 5 | cw[7] << 4 | cw[8] << 3 | cw[9] << 2 | cw[10] << 1 | cw[11];
-      retval[2] = cw[12] << 7 | cw[13] << 6 | cw[14] << 5 | cw[15] << 4 | cw[16] << 3 | cw[17] << 2 | cw[18] << 1 | cw[19];
-      retval[3] = cw[20] << 7 | cw[21] << 6 | cw[22] << 5 | cw[23] << 4 | cw[24] << 3 | cw[25] << 2 | cw[26] << 1 | cw[27];
-      retval[4] = cw[28] << 7 | cw[29] << 6 | cw[30] << 5 | cw[31] << 4 | cw[32] << 3 | cw[33] << 2 | (retval[4] & 0x3);
-      free(cw);
+      /* parity bits cw[0] to cw[33] follow the preamble, MSB first */
+      uint64_t parity = 0;
+      for (count = 0; count < 34; count++)
+        parity |= ((cw >> count) & 1) << (33 - count);
+      ac[0] = (parity >> 30) & 0x0f;
+      ac[1] = (parity >> 22) & 0xff;
+      ac[2] = (parity >> 14) & 0xff;
+      ac[3] = (parity >> 6) & 0xff;
+      ac[4] = ((parity & 0x3f) << 2) | (ac[4] & 0x3);
 
       for(count = 0; count < 9; count++)
-        retval[count] ^= pn[count];
+        ac[count] ^= pn[count];
 
       /* Preamble */
-      if(retval[0] & 0x08)
-        retval[0] |= 0xa0;
+      if(ac[0] & 0x08)
+        ac[0] |= 0xa0;
       else
-        retval[0] |= 0x50;
-
-      return retval;
+        ac[0] |= 0x50;
     }
 
     /* Decode 1/3 rate FEC, three like symbols in a row */
     bool classic_packet::unfec13(char *input, char *output, int length)
     {
-      int a, b, c, i;
+      symbol_buffer symbols(input, 3 * length);
+      return unfec13(symbols, 0, output, length);
+    }
+
+    bool classic_packet::unfec13(const symbol_buffer& input, int offset, char *output, int length)
+    {
+      int i;
       int be = 0; /* bit errors */
 
       for (i = 0; i < length; i++) {
-        a = 3 * i;
-        b = a + 1;
-        c = a + 2;
-        output[i] = ((input[a] & input[b]) | (input[b] & input[c]) |
-                     (input[c] & input[a]));
-        be += ((input[a] ^ input[b]) | (input[b] ^ input[c]) |
-               (input[c] ^ input[a]));
+        /* majority vote, and whether the vote was unanimous */
+        int triple = input.bits(offset + 3 * i, 3);
+        output[i] = (0xe8 >> triple) & 1;
+        be += (triple != 0) && (triple != 7);
       }
 
       return (be < (length / 4));
@@ -385,168 +666,239 @@ namespace gr {
     /* Decode 2/3 rate FEC, a (15,10) shortened Hamming code */
     char *classic_packet::unfec23(char *input, int length)
     {
-      /* input points to the input data
-       * length is length in bits of the data
-       * before it was encoded with fec2/3 */
-      int iptr, optr, blocks;
-      char* output;
-      uint8_t difference, count, *codeword;
-      uint8_t fecgen[] = {1,1,0,1,0,1};
-
-      iptr = -15;
-      optr = -10;
-      difference = length % 10;
-      // padding at end of data
-      if(0!=difference)
-        length += (10 - difference);
-
-      blocks = length/10;
-      output = (char *) malloc(length);
-
-      while(blocks) {
-        iptr += 15;
-        optr += 10;
-        blocks--;
-
-        // copy data to output
-        for(count=0;count<10;count++)
-          output[optr+count] = input[iptr+count];
-
-        // call fec23gen on data to generate the codeword
-        //codeword = fec23gen(input+iptr);
-        codeword = lfsr((uint8_t *) input+iptr, 15, 10, fecgen);
-
-        // compare codeword to the 5 received bits
-        difference = 0;
-        for(count=0;count<5;count++)
-          if(codeword[count]!=input[iptr+10+count])
-            difference++;
-
-        /* no errors or single bit errors (errors in the parity bit):
-         * (a strong hint it's a real packet) */
-        if((0==difference) || (1==difference)) {
-          free(codeword);
-          continue;
-        }
+      int blocks = (length + 9) / 10;
+      symbol_buffer symbols(input, 15 * blocks);
+      return unfec23(symbols, 0, length);
+    }
 
-        // multiple different bits in the codeword
-        for(count=0;count<5;count++) {
-          difference |= codeword[count] ^ input[iptr+10+count];
-          difference <<= 1;
-        }
-        free(codeword);
-
-        switch (difference) {
-          /* comments are the bit that's wrong and the value
-           * of difference in binary, from the BT spec */
-          // 1000000000 11010
-        case 26: output[optr] ^= 1; break;
-          // 0100000000 01101
-        case 13: output[optr+1] ^= 1; break;
-          // 0010000000 11100
-        case 28: output[optr+2] ^= 1; break;
-          // 0001000000 01110
-        case 14: output[optr+3] ^= 1; break;
-          // 0000100000 00111
-        case 7: output[optr+4] ^= 1; break;
-          // 0000010000 11001
-        case 25: output[optr+5] ^= 1; break;
-          // 0000001000 10110
-        case 22: output[optr+6] ^= 1; break;
-          // 0000000100 01011
-        case 11: output[optr+7] ^= 1; break;
-          // 0000000010 11111
-        case 31: output[optr+8] ^= 1; break;
-          // 0000000001 10101
-        case 21: output[optr+9] ^= 1; break;
-          /* not one of these errors, probably multiple bit errors
-           * or maybe not a real packet, safe to drop it? */
-        default: free(output); return NULL;
-        }
+    char *classic_packet::unfec23(const symbol_buffer& stream, int offset, int length)
+    {
+      char *output = (char *) malloc(((length + 9) / 10) * 10);
+      if (!unfec23(stream, offset, output, length)) {
+        free(output);
+        return NULL;
       }
       return output;
     }
 
+    /*
+     * Syndrome decoding tables for the (15,10) code.  Parity is linear in
+     * the data, so the parity of each data word is the XOR of the
+     * columns for its set bits (codeword[0] from lfsr() in the LSB).  A
+     * syndrome selects the data bit to flip: none when it is zero or
+     * points at a single parity bit, -1 when no single bit error gives
+     * it.  The columns are the syndromes the BT spec lists, in air order.
+     *
+     * This is a decode change, not just a faster decoder: the old code
+     * never reset the mismatch count before building its syndrome and
+     * shifted it one place too far, so it matched no odd syndrome and
+     * returned NULL for single data bit errors that now get corrected.
+     */
+    struct fec23_tables {
+      uint8_t parity[1024];
+      int16_t correction[32];
+
+      fec23_tables()
+      {
+        static const uint8_t columns[10] = {11, 22, 7, 14, 28, 19, 13, 26, 31, 21};
+        int data, bit;
+
+        for (data = 0; data < 1024; data++) {
+          parity[data] = 0;
+          for (bit = 0; bit < 10; bit++)
+            if (data & (1 << bit))
+              parity[data] ^= columns[bit];
+        }
+        for (data = 0; data < 32; data++)
+          correction[data] = (__builtin_popcount(data) <= 1) ? 0 : -1;
+        for (bit = 0; bit < 10; bit++)
+          correction[columns[bit]] = 1 << bit;
+      }
+    };
+
+    static const fec23_tables FEC23_TABLES;
+
+    int classic_packet::unfec23_block(uint32_t block)
+    {
+      int data = block & 0x3ff;
+      int syndrome = FEC23_TABLES.parity[data] ^ ((block >> 10) & 0x1f);
+      int flip = FEC23_TABLES.correction[syndrome];
+
+      return (flip < 0) ? -1 : (data ^ flip);
+    }
+
+    bool classic_packet::unfec23(const symbol_buffer& stream, int offset, char *output, int length)
+    {
+      /* stream holds the input data from offset
+       * length is length in bits of the data
+       * before it was encoded with fec2/3 */
+      int block, count;
+      int blocks = (length + 9) / 10;
+
+      for (block = 0; block < blocks; block++) {
+        int data = unfec23_block(stream.bits(offset + 15 * block, 15));
+        /* probably multiple bit errors or maybe not a real packet */
+        if (data < 0)
+          return false;
+        for (count = 0; count < 10; count++)
+          output[10 * block + count] = (data >> count) & 1;
+      }
+      return true;
+    }
+
     /* Create an Access Code from LAP and check it against stream */
     bool classic_packet::check_ac(char *stream, int LAP)
     {
-      int count, aclength, biterrors;
-      uint8_t *ac, *grdata;
-      aclength = 72;
-      biterrors = 0;
+      symbol_buffer symbols(stream, SYMBOLS_PER_BASIC_RATE_ACCESS_CODE);
+      return check_ac(symbols, 0, LAP);
+    }
 
-      /* Generate AC */
-      ac = acgen(LAP);
+    bool classic_packet::check_ac(const symbol_buffer& stream, int offset, int LAP)
+    {
+      /* Generate AC, already packed, and check it */
+      int biterrors = ac_errors(AC_TABLES, stream, offset, LAP);
 
-      /* Check AC */
-      /* Convert it to grformat, 1 bit per byte, in the LSB */
-      grdata = (uint8_t *) malloc(aclength);
+      //FIXME do error correction instead of detection
+      if(biterrors>=7)
+        return false;
+      //if(biterrors)
+      //  printf("POSSIBLE PACKET, LAP = %06x with %d errors\n", LAP, biterrors);
+      return true;
+    }
 
-      for(count = 0; count < 9; count++)
-        convert_to_grformat(ac[count], &grdata[count*8]);
-      free(ac);
+    bool classic_packet_impl::payload_unfec23(int stream, char *output, int length)
+    {
+      int block, count;
+      int blocks = (length + 9) / 10;
 
-      for(count = 0; count < SYMBOLS_PER_BASIC_RATE_ACCESS_CODE; count++)
-	{
-          if(grdata[count] != stream[count])
-            biterrors++;
-          //FIXME do error correction instead of detection
-          if(biterrors>=7)
-            {
-              free(grdata);
-              return false;
-            }
-	}
-      if(biterrors)
-	{
-          //printf("POSSIBLE PACKET, LAP = %06x with %d errors\n", LAP, biterrors);
-          free(grdata);
-          //return false;
-          return true;
-	}
+      /* DV payloads start part way into a block, so start over for them */
+      if ((d_fec23_count == 0) || (stream < d_fec23_base) || ((stream - d_fec23_base) % 15)) {
+        d_fec23_base = stream;
+        d_fec23_count = 0;
+      }
 
-      free(grdata);
+      int first = (stream - d_fec23_base) / 15;
+      for (block = first; block < first + blocks; block++) {
+        /* blocks past the end of the symbols can't be decoded */
+        if (d_fec23_base + 15 * (block + 1) > MAX_SYMBOLS)
+          return false;
+        if ((int) d_fec23_blocks.size() <= block)
+          d_fec23_blocks.resize(block + 1);
+        for (; d_fec23_count <= block; d_fec23_count++)
+          d_fec23_blocks[d_fec23_count] =
+            unfec23_block(d_symbols.bits(d_fec23_base + 15 * d_fec23_count, 15));
+
+        int data = d_fec23_blocks[block];
+        if (data < 0)
+          return false;
+        for (count = 0; count < 10; count++)
+          output[10 * (block - first) + count] = (data >> count) & 1;
+      }
       return true;
     }
 
+    /* Remove the whitening from the packet's own symbols, starting at offset */
+    void classic_packet_impl::unwhiten(int offset, char* output, int clock, int length, int skip)
+    {
+      int count, bit, n;
+      unsigned index = (INDICES[clock & 0x3f] + skip) % 127;
+
+      /* 64 symbols at a time, unwhitened only if d_whitened */
+      for(count = 0; count < length; count += n) {
+        n = (length - count < 64) ? length - count : 64;
+        uint64_t bits = d_symbols.bits(offset + count, n);
+        if (d_whitened)
+          bits ^= whitening_bits(index + count, n);
+        for(bit = 0; bit < n; bit++)
+          output[count + bit] = (bits >> bit) & 1;
+      }
+    }
+
     /* Remove the whitening from an air order array */
     void classic_packet_impl::unwhiten(char* input, char* output, int clock, int length, int skip)
     {
-      int count, index;
-      index = INDICES[clock & 0x3f];
-      index += skip;
-      index %= 127;
+      int count, bit, n;
+      unsigned index = (INDICES[clock & 0x3f] + skip) % 127;
 
-      for(count = 0; count < length; count++) {
-        /* unwhiten if d_whitened, otherwise just copy input to output */
-        output[count] = (d_whitened) ? input[count] ^ WHITENING_DATA[index] : input[count];
-        index += 1;
-        index %= 127;
+      /* unwhiten if d_whitened, otherwise just copy input to output */
+      if (!d_whitened) {
+        memmove(output, input, length);
+        return;
+      }
+      for(count = 0; count < length; count += n) {
+        n = (length - count < 64) ? length - count : 64;
+        uint64_t bits = whitening_bits(index + count, n);
+        for(bit = 0; bit < n; bit++)
+          output[count + bit] = input[count + bit] ^ ((bits >> bit) & 1);
       }
     }
 
+    /*
+     * Byte at a time table for the payload CRC, the reflected form of
+     * CRC-CCITT that crcgen() clocks one bit at a time: air order bits
+     * go in LSB first, so a byte is eight of them with the first in bit 0.
+     */
+    struct crc16_tables {
+      uint16_t byte[256];
+
+      crc16_tables()
+      {
+        for (int value = 0; value < 256; value++) {
+          uint16_t reg = value;
+          for (int bit = 0; bit < 8; bit++)
+            reg = (reg >> 1) ^ ((reg & 1) ? 0x8408 : 0);
+          byte[value] = reg;
+        }
+      }
+    };
+
+    static const crc16_tables CRC16_TABLES;
+
+    /* clock n (<= 64) packed bits through the CRC register */
+    static uint16_t
+    crc16_update(uint16_t reg, uint64_t bits, int n)
+    {
+      for (; n >= 8; n -= 8, bits >>= 8)
+        reg = (reg >> 8) ^ CRC16_TABLES.byte[(reg ^ bits) & 0xff];
+      for (; n > 0; n--, bits >>= 1)
+        reg = (reg >> 1) ^ (((reg ^ bits) & 1) ? 0x8408 : 0);
+      return reg;
+    }
+
     /* Pointer to start of packet, length of packet in bits, UAP */
     uint16_t classic_packet::crcgen(char *payload, int length, int UAP)
     {
-      char byte;
-      uint16_t reg, count;
+      uint16_t reg;
+      int count;
 
       reg = (reverse(UAP) << 8) & 0xff00;
-      for(count = 0; count < length; count++)
-	{
-          byte = payload[count];
-
-          reg = (reg >> 1) | (((reg & 0x0001) ^ (byte & 0x01))<<15);
-
-          /*Bit 5*/
-          reg ^= ((reg & 0x8000)>>5);
-
-          /*Bit 12*/
-          reg ^= ((reg & 0x8000)>>12);
-	}
+      for(count = 0; count + 8 <= length; count += 8)
+        reg = crc16_update(reg, air_to_host8(&payload[count], 8), 8);
+      if(count < length)
+        reg = crc16_update(reg, air_to_host8(&payload[count], length - count), length - count);
       return reg;
     }
 
+    /*
+     * The CRC is linear: flipping payload bits changes the CRC by the
+     * CRC, from a zero register, of the flipped bits.  So unwhitening
+     * with clock changes crcgen() of the data XOR the CRC field by the
+     * same amount whatever the payload is, and that amount is this.
+     */
+    uint16_t classic_packet::whitening_crc(int clock, int skip, int length)
+    {
+      unsigned index = (INDICES[clock & 0x3f] + skip) % 127;
+      int data_length = length - 16;
+      uint16_t reg = 0;
+      int count, n;
+
+      for(count = 0; count < data_length; count += n) {
+        n = (data_length - count < 64) ? data_length - count : 64;
+        reg = crc16_update(reg, whitening_bits(index + count, n), n);
+      }
+      return reg ^ whitening_bits(index + data_length, 16);
+    }
+
     /* return the packet's LAP */
     uint32_t classic_packet_impl::get_LAP()
     {
@@ -593,8 +945,8 @@ namespace gr {
       d_have_clk27 = have27;
     }
 
-    /* extract UAP by reversing the HEC computation */
-    int classic_packet::UAP_from_hec(uint16_t data, uint8_t hec)
+    /* reverse the HEC computation one data bit at a time */
+    int classic_packet::UAP_from_hec_bits(uint16_t data, uint8_t hec)
     {
       int i;
 
@@ -605,7 +957,37 @@ namespace gr {
 
         hec = (hec << 1) | (((hec >> 7) ^ (data >> i)) & 0x01);
       }
-      return reverse(hec);
+      return packet::reverse(hec);
+    }
+
+    /*
+     * Running the HEC backwards is linear in the header data and HEC
+     * bits, so the UAP is the XOR of one entry for the HEC and one for
+     * each byte of header data.
+     */
+    struct hec_tables {
+      uint8_t hec[256];
+      uint8_t data_low[256];
+      uint8_t data_high[4];
+
+      hec_tables()
+      {
+        for (int value = 0; value < 256; value++) {
+          hec[value] = classic_packet::UAP_from_hec_bits(0, value);
+          data_low[value] = classic_packet::UAP_from_hec_bits(value, 0);
+        }
+        for (int value = 0; value < 4; value++)
+          data_high[value] = classic_packet::UAP_from_hec_bits(value << 8, 0);
+      }
+    };
+
+    static const hec_tables HEC_TABLES;
+
+    /* extract UAP by reversing the HEC computation */
+    int classic_packet::UAP_from_hec(uint16_t data, uint8_t hec)
+    {
+      return HEC_TABLES.hec[hec] ^ HEC_TABLES.data_low[data & 0xff] ^
+        HEC_TABLES.data_high[(data >> 8) & 0x3];
     }
 
     /* check if the classic_packet's CRC is correct for a given clock (CLK1-6) */
@@ -679,16 +1061,37 @@ namespace gr {
       uint16_t crc;   /* CRC calculated from payload data */
       uint16_t check; /* CRC supplied by packet */
 
-      crc = crcgen(d_payload, (d_payload_length - 2) * 8, d_UAP);
-      check = air_to_host16(&d_payload[(d_payload_length - 2) * 8], 16);
+      char *payload = payload_bits(d_payload_length * 8);
+      crc = crcgen(payload, (d_payload_length - 2) * 8, d_UAP);
+      check = air_to_host16(&payload[(d_payload_length - 2) * 8], 16);
 
       return (crc == check);
     }
 
+    /* CRC register before any payload bits, as crcgen() starts it */
+    uint16_t classic_packet_impl::payload_crc_start()
+    {
+      return (reverse(d_UAP) << 8) & 0xff00;
+    }
+
+    /*
+     * payload_crc() for a payload growing a byte at a time: crc holds the
+     * CRC of its first crc_bytes bytes and is brought up to date, so
+     * each length tried only adds the bytes new since the last one.
+     */
+    bool classic_packet_impl::payload_crc(uint16_t& crc, int& crc_bytes)
+    {
+      char *payload = payload_bits(d_payload_length * 8);
+      for (; crc_bytes < d_payload_length - 2; crc_bytes++)
+        crc = crc16_update(crc, air_to_host8(&payload[crc_bytes * 8], 8), 8);
+
+      return (crc == air_to_host16(&payload[(d_payload_length - 2) * 8], 16));
+    }
+
     int classic_packet_impl::fhs(int clock)
     {
       /* skip the access code and packet header */
-      char *stream = d_symbols + 126;
+      int stream = 126;
       /* number of symbols remaining after access code and packet header */
       int size = d_length - 126;
 
@@ -697,33 +1100,36 @@ namespace gr {
       if (size < d_payload_length * 12)
         return 1; //FIXME should throw exception
 
-      char *corrected = unfec23(stream, d_payload_length * 8);
-      if (!corrected)
+      char corrected[160];
+      if (!payload_unfec23(stream, corrected, d_payload_length * 8))
         return 0;
 
+      /* how far the still whitened payload's CRC is off, see whitening_crc() */
+      int length = d_payload_length * 8;
+      uint16_t crc = crcgen(corrected, length - 16, d_UAP) ^
+        air_to_host16(&corrected[length - 16], 16);
+
       /* try to unwhiten with known clock bits */
-      unwhiten(corrected, d_payload, clock, d_payload_length * 8, 18);
-      if (payload_crc()) {
-        free(corrected);
+      if (crc == (d_whitened ? whitening_crc(clock, 18, length) : 0)) {
+        unwhiten(corrected, payload_bits(length), clock, length, 18);
         return 1000;
       }
 
       /* try all 32 possible X-input values instead */
-      for (clock = 32; clock < 64; clock++) {
-        unwhiten(corrected, d_payload, clock, d_payload_length * 8, 18);
-        if (payload_crc()) {
-          free(corrected);
+      for (int x = 32; d_whitened && x < 64; x++) {
+        if (crc == whitening_crc(x, 18, length)) {
+          unwhiten(corrected, payload_bits(length), x, length, 18);
           return 1000;
         }
       }
 
-      /* failed to unwhiten */
-      free(corrected);
+      /* failed to unwhiten, leave the payload as the known clock bits give it */
+      unwhiten(corrected, payload_bits(length), clock, length, 18);
       return 0;
     }
 
     /* decode payload header, return value indicates success */
-    bool classic_packet_impl::decode_payload_header(char *stream, int clock, int header_bytes, int size, bool fec)
+    bool classic_packet_impl::decode_payload_header(int stream, int clock, int header_bytes, int size, bool fec)
     {
       if(header_bytes == 2)
 	{
@@ -732,11 +1138,10 @@ namespace gr {
           if(fec) {
             if(size < 30)
               return false; //FIXME should throw exception
-            char *corrected = unfec23(stream, 16);
-            if (!corrected)
+            char corrected[20];
+            if (!payload_unfec23(stream, corrected, 16))
               return false;
             unwhiten(corrected, d_payload_header, clock, 16, 18);
-            free(corrected);
           } else {
             unwhiten(stream, d_payload_header, clock, 16, 18);
           }
@@ -748,11 +1153,10 @@ namespace gr {
         if(fec) {
           if(size < 15)
             return false; //FIXME should throw exception
-          char *corrected = unfec23(stream, 8);
-          if (!corrected)
+          char corrected[10];
+          if (!payload_unfec23(stream, corrected, 8))
             return false;
           unwhiten(corrected, d_payload_header, clock, 8, 18);
-          free(corrected);
         } else {
           unwhiten(stream, d_payload_header, clock, 8, 18);
         }
@@ -774,7 +1178,7 @@ namespace gr {
       /* maximum payload length */
       int max_length;
       /* skip the access code and packet header */
-      char *stream = d_symbols + 126;
+      int stream = 126;
       /* number of symbols remaining after access code and packet header */
       int size = d_length - 126;
 
@@ -815,11 +1219,10 @@ namespace gr {
       if(bitlength > size)
         return 1; //FIXME should throw exception
 
-      char *corrected = unfec23(stream, bitlength);
-      if (!corrected)
+      char corrected[bitlength + 9];
+      if (!payload_unfec23(stream, corrected, bitlength))
         return 0;
-      unwhiten(corrected, d_payload, clock, bitlength, 18);
-      free(corrected);
+      unwhiten(corrected, payload_bits(bitlength), clock, bitlength, 18);
 
       if (payload_crc())
         return 10;
@@ -838,7 +1241,7 @@ namespace gr {
       /* maximum payload length */
       int max_length;
       /* skip the access code and packet header */
-      char *stream = d_symbols + 126;
+      int stream = 126;
       /* number of symbols remaining after access code and packet header */
       int size = d_length - 126;
 	
@@ -868,7 +1271,7 @@ namespace gr {
       if(bitlength > size)
         return 1; //FIXME should throw exception
 
-      unwhiten(stream, d_payload, clock, bitlength, 18);
+      unwhiten(stream, payload_bits(bitlength), clock, bitlength, 18);
 	
       /* AUX1 has no CRC */
       if (d_packet_type == 9)
@@ -884,7 +1287,7 @@ namespace gr {
     int classic_packet_impl::EV3(int clock)
     {
       /* skip the access code and packet header */
-      char *stream = d_symbols + 126;
+      int stream = 126;
 
       /* number of symbols remaining after access code and packet header */
       int size = d_length - 126;
@@ -895,6 +1298,10 @@ namespace gr {
       /* number of bits we have decoded */
       int bits;
 
+      /* running CRC of the payload so far */
+      uint16_t crc = payload_crc_start();
+      int crc_bytes = 0;
+
       /* check CRC for any integer byte length up to maxlength */
       for (d_payload_length = 0;
            d_payload_length < maxlength; d_payload_length++) {
@@ -904,9 +1311,9 @@ namespace gr {
         /* unwhiten next byte */
         if ((bits + 8) > size)
           return 1; //FIXME should throw exception
-        unwhiten(stream, d_payload + bits, clock, 8, 18 + bits);
+        unwhiten(stream, payload_bits(bits + 8) + bits, clock, 8, 18 + bits);
 
-        if ((d_payload_length > 2) && (payload_crc()))
+        if ((d_payload_length > 2) && (payload_crc(crc, crc_bytes)))
           return 10;
       }
       return 1;
@@ -914,10 +1321,10 @@ namespace gr {
 
     int classic_packet_impl::EV4(int clock)
     {
-      char *corrected;
+      char corrected[10];
 
       /* skip the access code and packet header */
-      char *stream = d_symbols + 126;
+      int stream = 126;
 
       /* number of symbols remaining after access code and packet header */
       int size = d_length - 126;
@@ -937,6 +1344,10 @@ namespace gr {
       int syms = 0; /* number of symbols we have decoded */
       int bits = 0; /* number of payload bits we have decoded */
 
+      /* running CRC of the payload so far */
+      uint16_t crc = payload_crc_start();
+      int crc_bytes = 0;
+
       d_payload_length = 1;
 
       while (syms < maxlength) {
@@ -944,20 +1355,17 @@ namespace gr {
         /* unfec/unwhiten next block (15 symbols -> 10 bits) */
         if (syms + 15 > size)
           return 1; //FIXME should throw exception
-        corrected = unfec23(stream + syms, 10);
-        if (!corrected) {
-          free(corrected);
+        if (!payload_unfec23(stream + syms, corrected, 10)) {
           if (syms < minlength)
             return 0;
           else
             return 1;
         }
-        unwhiten(corrected, d_payload + bits, clock, 10, 18 + bits);
-        free(corrected);
+        unwhiten(corrected, payload_bits(bits + 10) + bits, clock, 10, 18 + bits);
 
         /* check CRC one byte at a time */
         while (d_payload_length * 8 <= bits) {
-          if (payload_crc())
+          if (payload_crc(crc, crc_bytes))
             return 10;
           d_payload_length++;
         }
@@ -970,7 +1378,7 @@ namespace gr {
     int classic_packet_impl::EV5(int clock)
     {
       /* skip the access code and packet header */
-      char *stream = d_symbols + 126;
+      int stream = 126;
 
       /* number of symbols remaining after access code and packet header */
       int size = d_length - 126;
@@ -981,6 +1389,10 @@ namespace gr {
       /* number of bits we have decoded */
       int bits;
 
+      /* running CRC of the payload so far */
+      uint16_t crc = payload_crc_start();
+      int crc_bytes = 0;
+
       /* check CRC for any integer byte length up to maxlength */
       for (d_payload_length = 0;
            d_payload_length < maxlength; d_payload_length++) {
@@ -990,9 +1402,9 @@ namespace gr {
         /* unwhiten next byte */
         if ((bits + 8) > size)
           return 1; //FIXME should throw exception
-        unwhiten(stream, d_payload + bits, clock, 8, 18 + bits);
+        unwhiten(stream, payload_bits(bits + 8) + bits, clock, 8, 18 + bits);
 
-        if ((d_payload_length > 2) && (payload_crc()))
+        if ((d_payload_length > 2) && (payload_crc(crc, crc_bytes)))
           return 10;
       }
       return 1;
@@ -1002,7 +1414,7 @@ namespace gr {
     int classic_packet_impl::HV(int clock)
     {
       /* skip the access code and packet header */
-      char *stream = d_symbols + 126;
+      int stream = 126;
       /* number of symbols remaining after access code and packet header */
       int size = d_length - 126;
 
@@ -1015,25 +1427,24 @@ namespace gr {
       case 5:/* HV1 */
         {
           char corrected[80];
-          if (!unfec13(stream, corrected, 80))
+          if (!unfec13(d_symbols, stream, corrected, 80))
             return 0;
           d_payload_length = 10;
-          unwhiten(corrected, d_payload, clock, d_payload_length*8, 18);
+          unwhiten(corrected, payload_bits(d_payload_length*8), clock, d_payload_length*8, 18);
         }
         break;
       case 6:/* HV2 */
         {
-          char *corrected = unfec23(stream, 160);
-          if (!corrected)
+          char corrected[160];
+          if (!payload_unfec23(stream, corrected, 160))
             return 0;
           d_payload_length = 20;
-          unwhiten(corrected, d_payload, clock, d_payload_length*8, 18);
-          free(corrected);
+          unwhiten(corrected, payload_bits(d_payload_length*8), clock, d_payload_length*8, 18);
         }
         break;
       case 7:/* HV3 */
         d_payload_length = 30;
-        unwhiten(stream, d_payload, clock, d_payload_length*8, 18);
+        unwhiten(stream, payload_bits(d_payload_length*8), clock, d_payload_length*8, 18);
         break;
       }
 
@@ -1046,12 +1457,12 @@ namespace gr {
     uint8_t classic_packet_impl::try_clock(int clock)
     {
       /* skip 72 bit access code */
-      char *stream = d_symbols + 72;
+      int stream = 72;
       /* 18 bit packet header */
       char header[18];
       char unwhitened[18];
 
-      if (!unfec13(stream, header, 18))
+      if (!unfec13(d_symbols, stream, header, 18))
         return 0;
       unwhiten(header, unwhitened, clock, 18, 0);
       uint16_t hdr_data = air_to_host16(unwhitened, 10);
@@ -1062,16 +1473,57 @@ namespace gr {
       return d_UAP;
     }
 
+    /* packet header whitening for each clock (CLK1-6), the first bit in the LSB */
+    struct header_whitening_table {
+      uint32_t clock[64];
+
+      header_whitening_table()
+      {
+        for (int count = 0; count < 64; count++)
+          clock[count] = whitening_bits(classic_packet::INDICES[count], 18);
+      }
+    };
+
+    static const header_whitening_table HEADER_WHITENING;
+
+    void classic_packet_impl::check_clocks(uint64_t clocks, const int *want_UAP,
+                                           uint8_t *UAPs, int *results)
+    {
+      /* 18 bit packet header after the 72 bit access code, FEC decoded once */
+      char header[18];
+      bool fec = unfec13(d_symbols, 72, header, 18);
+      uint32_t whitened = air_to_host32(header, 18);
+
+      for (; clocks; clocks &= clocks - 1) {
+        int clock = __builtin_ctzll(clocks);
+
+        /* the same as try_clock(clock) */
+        if (fec) {
+          uint32_t unwhitened = d_whitened ? whitened ^ HEADER_WHITENING.clock[clock] : whitened;
+          d_UAP = classic_packet::UAP_from_hec(unwhitened & 0x3ff, unwhitened >> 10);
+          d_packet_type = (unwhitened >> 3) & 0xf;
+          UAPs[clock] = d_UAP;
+        } else {
+          UAPs[clock] = 0;
+        }
+
+        if ((want_UAP[clock] < 0) || (UAPs[clock] == want_UAP[clock]))
+          results[clock] = crc_check(clock);
+        else
+          results[clock] = -1;
+      }
+    }
+
     /* decode the packet header */
     bool classic_packet_impl::decode_header()
     {
       /* skip 72 bit access code */
-      char *stream = d_symbols + 72;
+      int stream = 72;
       /* 18 bit packet header */
       char header[18];
       uint8_t UAP;
 
-      if (d_have_clk6 && unfec13(stream, header, 18)) {
+      if (d_have_clk6 && unfec13(d_symbols, stream, header, 18)) {
         unwhiten(header, d_packet_header, d_clock, 18, 0);
         uint16_t hdr_data = air_to_host16(d_packet_header, 10);
         uint8_t hec = air_to_host8(&d_packet_header[10], 8);
@@ -1195,31 +1647,34 @@ namespace gr {
       /* HEC */
       tun_format[8] = (char) air_to_host8(&d_packet_header[10], 8);
 
+      char *payload = payload_bits(d_payload_length*8);
       for(i=0;i<d_payload_length;i++)
-        tun_format[i+9] = (char) air_to_host8(&d_payload[i*8], 8);
+        tun_format[i+9] = (char) air_to_host8(&payload[i*8], 8);
 
       return tun_format;
     }
 
     /* check to see if the packet has a header */
     bool classic_packet_impl::header_present()
+    {
+      return classic_packet::header_present(d_symbols, 0, d_length);
+    }
+
+    bool classic_packet::header_present(const symbol_buffer& symbols, int offset, int length)
     {
       /* skip to last bit of sync word */
-      char *stream = d_symbols + 67;
+      int stream = offset + 67;
       int be = 0; /* bit errors */
-      char msb;   /* most significant (last) bit of sync word */
-      int a, b, c;
+      int msb;    /* most significant (last) bit of sync word */
+      int a;
 
       /* check that we have enough symbols */
-      if (d_length < 126)
+      if (length < 126)
         return false;
 
-      /* check that the AC trailer is correct */
-      msb = stream[0];
-      be += stream[1] ^ !msb;
-      be += stream[2] ^ msb;
-      be += stream[3] ^ !msb;
-      be += stream[4] ^ msb;
+      /* check that the AC trailer is correct, alternating after msb */
+      msb = symbols[stream];
+      be += symbols.distance(stream + 1, msb ? 0xa : 0x5, 4);
 
       /*
        * Each bit of the 18 bit header is repeated three times.  Without
@@ -1228,10 +1683,8 @@ namespace gr {
        */
       stream += 5;
       for (a = 0; a < 54; a += 3) {
-        b = a + 1;
-        c = a + 2;
-        be += ((stream[a] ^ stream[b]) |
-               (stream[b] ^ stream[c]) | (stream[c] ^ stream[a]));
+        int triple = symbols.bits(stream + a, 3);
+        be += (triple != 0) && (triple != 7);
       }
 
       /*
@@ -1245,21 +1698,21 @@ namespace gr {
     uint32_t classic_packet_impl::lap_from_fhs()
     {
       /* caller should check got_payload() and get_type() */
-      return air_to_host32(&d_payload[34], 24);
+      return air_to_host32(&payload_bits(160)[34], 24);
     }
 
     /* extract UAP from FHS payload */
     uint8_t classic_packet_impl::uap_from_fhs()
     {
       /* caller should check got_payload() and get_type() */
-      return air_to_host8(&d_payload[64], 8);
+      return air_to_host8(&payload_bits(160)[64], 8);
     }
 
     /* extract NAP from FHS payload */
     uint16_t classic_packet_impl::nap_from_fhs()
     {
       /* caller should check got_payload() and get_type() */
-      return air_to_host8(&d_payload[72], 16);
+      return air_to_host8(&payload_bits(160)[72], 16);
     }
 
     /* extract clock from FHS payload */
@@ -1271,7 +1724,7 @@ namespace gr {
        * This is CLK2-27 (units of 1.25 ms).
        * CLK0 and CLK1 are implicitly zero.
        */
-      return air_to_host32(&d_payload[115], 26);
+      return air_to_host32(&payload_bits(160)[115], 26);
     }
 
     // -------------------------------------------------------------------
@@ -1279,7 +1732,14 @@ namespace gr {
     le_packet::sptr 
     le_packet::make(char *stream, int length, double freq) 
     {
-      return le_packet::sptr(new le_packet_impl(stream, length, freq));
+      symbol_buffer symbols(stream, length);
+      return make(symbols, 0, length, freq);
+    }
+
+    le_packet::sptr 
+    le_packet::make(const symbol_buffer& stream, int offset, int length, double freq) 
+    {
+      return packet_pool<le_packet_impl>::instance().make<le_packet::sptr>(stream, offset, length, freq);
     }
 
     int le_packet::freq2chan(const double freq) {
@@ -1451,6 +1911,29 @@ namespace gr {
 
     int
     le_packet::sniff_aa(char *stream, int stream_length, double freq)
+    {
+      /* the header of a match at stream_length - 1 ends 56 symbols on */
+      symbol_buffer symbols(stream, stream_length + 55);
+      return sniff_aa(symbols, 0, stream_length, freq);
+    }
+
+    int
+    le_packet::sniff_aa(const symbol_buffer& stream, int offset, int stream_length, double freq)
+    {
+      return find_aa(stream, offset, stream_length, freq, NULL);
+    }
+
+    int
+    le_packet::sniff_aa(const symbol_buffer& stream, int offset, int stream_length, double freq,
+                        const access_address_set& aas)
+    {
+      return find_aa(stream, offset, stream_length, freq, &aas);
+    }
+
+    /* sniff_aa(), with the set of data channel AAs to accept, if any */
+    int
+    le_packet::find_aa(const symbol_buffer& stream, int offset, int stream_length, double freq,
+                       const access_address_set *aas)
     {
       /* Looks for AA */
       int count;
@@ -1466,24 +1949,26 @@ namespace gr {
       else if (index < 0) {
         return -1;
       }
+      else if (aas && aas->empty()) {
+        // no connections to look for
+        return -1;
+      }
       else {
         phlsb = DATA_HEADER_DISTANCE_LSB;
         phmsb = DATA_HEADER_DISTANCE_MSB;
       }
 
+      uint16_t header_whitening = whitening_bits(INDICES[index], 16);
+
       for( count=0; count<stream_length; count++ ) {
-        char *   symbols    = &stream[count];
-        uint16_t preamble   = air_to_host16(&symbols[0], 9);
-        char hbuf[16];
-        unsigned hi, wi;
+        int      pos        = offset + count;
+        uint16_t preamble   = stream.bits(pos, 9);
 
         // de-whiten 
-        for( hi=0, wi=INDICES[index]; hi<16; hi++, wi=(wi+1)%127 ) {
-          hbuf[hi] = symbols[hi+40] ^ WHITENING_DATA[wi];
-        }
+        uint16_t header     = stream.bits(pos + 40, 16) ^ header_whitening;
 
-        uint8_t  header_lsb = air_to_host8(&hbuf[0], 8);
-        uint8_t  header_msb = air_to_host8(&hbuf[8], 8);
+        uint8_t  header_lsb = header & 0xff;
+        uint8_t  header_msb = header >> 8;
 
         int preamble_distance = PREAMBLE_DISTANCE[preamble];
         int header_distance   = phlsb[header_lsb] + phmsb[header_msb];       
@@ -1493,14 +1978,11 @@ namespace gr {
 
         if (index >= 37) {
           // access channel
-          uint8_t aabyte = air_to_host8(&symbols[8], 8);
-          int aa_distance = ACCESS_ADDRESS_DISTANCE_0[aabyte];
-          aabyte = air_to_host8(&symbols[16], 8);
-          aa_distance += ACCESS_ADDRESS_DISTANCE_1[aabyte];
-          aabyte = air_to_host8(&symbols[24], 8);
-          aa_distance += ACCESS_ADDRESS_DISTANCE_2[aabyte];
-          aabyte = air_to_host8(&symbols[32], 8);
-          aa_distance += ACCESS_ADDRESS_DISTANCE_3[aabyte];
+          uint32_t aa = stream.bits(pos + 8, 32);
+          int aa_distance = ACCESS_ADDRESS_DISTANCE_0[aa & 0xff];
+          aa_distance += ACCESS_ADDRESS_DISTANCE_1[(aa >> 8) & 0xff];
+          aa_distance += ACCESS_ADDRESS_DISTANCE_2[(aa >> 16) & 0xff];
+          aa_distance += ACCESS_ADDRESS_DISTANCE_3[aa >> 24];
           if (!aa_distance && distance) {
             printf( "preamble_distance=%d, header_distance=%d, aa_distance=%d\n", 
                     preamble_distance, header_distance, aa_distance );
@@ -1509,14 +1991,21 @@ namespace gr {
             }
             if (header_distance) {
               printf( "de_whitened: header_lsb=0x%02x, header_msb=0x%02x\n", header_lsb, header_msb );
-              uint8_t  raw_lsb = air_to_host8(&stream[40], 8);
-              uint8_t  raw_msb = air_to_host8(&stream[48], 8);
+              uint8_t  raw_lsb = stream.bits(offset + 40, 8);
+              uint8_t  raw_msb = stream.bits(offset + 48, 8);
               printf( "raw:         header_lsb=0x%02x, header_msb=0x%02x\n", raw_lsb, raw_msb );
             }
           }
           distance += aa_distance;
           max_distance += 2;
         }
+        else if (aas) {
+          // data channel, any live connection
+          if ((distance > 2) || !aas->contains(stream.bits(pos + 8, 32))) {
+            continue;
+          }
+          max_distance += 2;
+        }
 
         if (distance <= max_distance) {
           return count;
@@ -1526,24 +2015,70 @@ namespace gr {
       return -1;
     }
 
-    le_packet_impl::le_packet_impl(char *stream, int length, double freq)
-      : packet(stream, length, freq)
+    /*
+     * Byte at a time table for the LE CRC24, x^24 + x^10 + x^9 + x^6 +
+     * x^4 + x^3 + x + 1.  PDU bytes go in LSB first, so the register is
+     * kept reflected and comes out in the order the CRC is sent.
+     */
+    struct crc24_tables {
+      uint32_t byte[256];
+
+      crc24_tables()
+      {
+        for (int value = 0; value < 256; value++) {
+          uint32_t reg = value;
+          for (int bit = 0; bit < 8; bit++)
+            reg = (reg >> 1) ^ ((reg & 1) ? 0xda6000 : 0);
+          byte[value] = reg;
+        }
+      }
+    };
+
+    static const crc24_tables CRC24_TABLES;
+
+    uint32_t le_packet::crcgen(const uint8_t *data, int length, uint32_t crc_init)
     {
-      d_index = freq2index( freq );
+      /* CRCInit is given MSB first, the register runs LSB first */
+      uint32_t reg = 0;
+      for (int bit = 0; bit < 24; bit++)
+        reg |= ((crc_init >> bit) & 1) << (23 - bit);
 
-      (void) ::memcpy( &d_link_symbols[0], stream, LE_MAX_SYMBOLS );
+      for (int count = 0; count < length; count++)
+        reg = (reg >> 8) ^ CRC24_TABLES.byte[(reg ^ data[count]) & 0xff];
+      return reg;
+    }
 
+    le_packet_impl::le_packet_impl(const symbol_buffer& stream, int offset, int length, double freq)
+      : packet(stream, offset, length, freq)
+    {
+      start();
+    }
+
+    void le_packet_impl::reset(const symbol_buffer& stream, int offset, int length, double freq)
+    {
+      packet::reset(stream, offset, length, freq);
+      start();
+    }
+
+    void le_packet_impl::start()
+    {
+      d_index = freq2index( d_freq );
+
+      /* everything after the access address is whitened */
       unsigned i, wi = INDICES[d_index];
-      for( i=40; i<LE_MAX_SYMBOLS; i++, wi=(wi+1)%127 ) {
-        d_link_symbols[i] ^= WHITENING_DATA[wi];
-      }
 
-      d_AA             = air_to_host32(&d_link_symbols[8], 32);
+      d_AA             = d_symbols.bits(8, 32);
       d_whitened       = true;
       d_have_payload   = false;
       d_payload_length = 0;
+      d_crc_init       = ADVERTISING_CRC_INIT;
+      d_have_crc_init  = (d_index >= 37);
+
+      /* a recycled packet must not keep the other kind's header fields */
+      d_PDU_Type = d_TxAdd = d_RxAdd = 0;
+      d_LLID = d_NESN = d_SN = d_MD = 0;
 
-      uint16_t header = air_to_host16(&d_link_symbols[40], 16);
+      uint16_t header = d_symbols.bits(40, 16) ^ whitening_bits(wi, 16);
       if (d_index >= 37) {
         d_PDU_Type   = (header >> 0) & 0xf;
         d_TxAdd      = (header >> 6) & 1;
@@ -1560,7 +2095,7 @@ namespace gr {
 
       unsigned pi;
       for( pi=0, i=56; i+8<LE_MAX_SYMBOLS; pi++, i+=8 ) {
-        d_pdu[pi] = air_to_host8(&d_link_symbols[i], 8);
+        d_pdu[pi] = d_symbols.bits(i, 8) ^ whitening_bits(wi + i - 40, 8);
       }
     }
 
@@ -1568,14 +2103,58 @@ namespace gr {
     {
     }
 
+    void le_packet_impl::set_crc_init(uint32_t crc_init)
+    {
+      d_crc_init      = crc_init & 0xffffff;
+      d_have_crc_init = true;
+    }
+
+    /* check the CRC, which covers the header and the payload */
     bool le_packet_impl::decode_header()
     {
-      return false; // FIXME: TODO
+      if (!d_have_crc_init || !header_present())
+        return false;
+
+      unsigned count, wi = INDICES[d_index];
+      unsigned octets = 2 + d_PDU_Length;
+      uint8_t data[LE_MAX_PDU_OCTETS];
+
+      for (count = 0; count < octets; count++)
+        data[count] = d_symbols.bits(40 + 8 * count, 8) ^ whitening_bits(wi + 8 * count, 8);
+      uint32_t crc = d_symbols.bits(40 + 8 * octets, 24) ^ whitening_bits(wi + 8 * octets, 24);
+
+      return (crcgen(data, octets, d_crc_init) == crc);
     }
-    
+
     void le_packet_impl::decode_payload()
     {
-      // FIXME: TODO
+      unsigned count;
+      char *payload = payload_bits(d_PDU_Length * 8);
+
+      d_payload_length = d_PDU_Length;
+      for (count = 0; count < d_PDU_Length; count++)
+        host_to_air(d_pdu[count], &payload[count * 8], 8);
+      d_have_payload = true;
+    }
+
+    bool le_packet_impl::terminate_ind()
+    {
+      /* an LL control PDU with opcode 0x02 */
+      return (d_have_payload && !is_advertising() && (d_LLID == 3) &&
+              (d_PDU_Length >= 1) && (d_pdu[0] == 0x02));
+    }
+
+    bool le_packet_impl::connect_req(uint32_t& aa, uint32_t& crc_init)
+    {
+      /* CONNECT_REQ has a 34 byte payload */
+      if (!d_have_payload || !is_advertising() || (d_PDU_Type != 5) || (d_PDU_Length != 34))
+        return false;
+
+      aa = d_pdu[12] | (((uint32_t) d_pdu[13]) << 8) |
+        (((uint32_t) d_pdu[14]) << 16) | (((uint32_t) d_pdu[15]) << 24);
+      crc_init = d_pdu[16] | (((uint32_t) d_pdu[17]) << 8) |
+        (((uint32_t) d_pdu[18]) << 16);
+      return true;
     }
            
     void le_packet_impl::print()
@@ -1598,7 +2177,7 @@ namespace gr {
           else {
             printf( "\n  (char) AdvData=" );
           }
-          for( i=6; i<d_PDU_Length; i++ ) {
+          for( i=6; i<d_PDU_Length && i<MAX_PDU_OCTETS; i++ ) {
             char c = (char) d_pdu[i];
             if ((c < ' ') || (c > '~')) {
               c = '.';
@@ -1611,7 +2190,7 @@ namespace gr {
           else {
             printf( "\n  (byte) AdvData=" );
           }
-          for( i=6; i<d_PDU_Length; i++ ) {
+          for( i=6; i<d_PDU_Length && i<MAX_PDU_OCTETS; i++ ) {
             printf( "%02x", d_pdu[i] );
           }
           printf( "\n" );
@@ -1664,14 +2243,31 @@ namespace gr {
       }
     }
       
+    /* AA, header, payload and CRC, as the link layer sends them */
     char *le_packet_impl::tun_format()
     {
-      return (char*)calloc(256,1); // FIXME: TODO
+      /* include 4 bytes for the AA, 2 for the header and 3 for the CRC */
+      int length = 9 + d_payload_length;
+      char *tun_format = (char *) malloc(length);
+      unsigned count, wi = INDICES[d_index];
+
+      tun_format[0] = d_AA & 0xff;
+      tun_format[1] = (d_AA >> 8) & 0xff;
+      tun_format[2] = (d_AA >> 16) & 0xff;
+      tun_format[3] = (d_AA >> 24) & 0xff;
+      for (count = 0; count < (unsigned) length - 4; count++)
+        tun_format[4 + count] = d_symbols.bits(40 + 8 * count, 8) ^ whitening_bits(wi + 8 * count, 8);
+
+      return tun_format;
     }
       
+    /* check that the header's length leaves room for the payload and CRC */
     bool le_packet_impl::header_present()
     {
-      return false; // FIXME: TODO
+      if ((d_index < 0) || (d_PDU_Length > MAX_PDU_OCTETS - 2))
+        return false;
+
+      return (d_length >= (int) (56 + 8 * d_PDU_Length + 24));
     }
 
   } /* namespace bluetooth */
@@ -28,6 +28,7 @@
 
 #include "gr_bluetooth/packet.h"
 #include <string>
+#include <vector>
 
 namespace gr {
   namespace bluetooth {
@@ -82,18 +83,43 @@ namespace gr {
       int HV(int clock);
 
       /* decode payload header, return value indicates success */
-      bool decode_payload_header(char *stream, int clock, int header_bytes, int size, bool fec);
+      bool decode_payload_header(int stream, int clock, int header_bytes, int size, bool fec);
 
       /* Remove the whitening from an air order array */
       void unwhiten(char* input, char* output, int clock, int length, int skip);
 
+      /* Remove the whitening from the packet's own symbols, starting at offset */
+      void unwhiten(int offset, char* output, int clock, int length, int skip);
+
       /* verify the payload CRC */
       bool payload_crc();
 
+      /* the same, carrying the CRC from one payload length to the next */
+      uint16_t payload_crc_start();
+      bool payload_crc(uint16_t& crc, int& crc_bytes);
+
+      /*
+       * FEC 2/3 blocks of the payload from symbol d_fec23_base on, as
+       * unfec23_block() gives them.  They are the same whatever clock
+       * is tried, so each is decoded once, the first time it is needed.
+       */
+      std::vector<int16_t> d_fec23_blocks;
+      int                  d_fec23_base;
+      int                  d_fec23_count;
+
+      /* unfec23() of the packet's own symbols from stream, through d_fec23_blocks */
+      bool payload_unfec23(int stream, char *output, int length);
+
+      /* the constructor's work after packet's, shared with reset() */
+      void start();
+
     public:
-      classic_packet_impl(char *stream, int length);
+      classic_packet_impl(const symbol_buffer& stream, int offset, int length, double freq=0.0);
       ~classic_packet_impl();
 
+      /* reuse for another packet, see packet_pool */
+      void reset(const symbol_buffer& stream, int offset, int length, double freq=0.0);
+
       /* return the classic_packet's LAP */
       uint32_t get_LAP();
 
@@ -120,6 +146,10 @@ namespace gr {
        */
       uint8_t try_clock(int clock);
 
+      /* try_clock() and crc_check() for every clock set in clocks */
+      void check_clocks(uint64_t clocks, const int *want_UAP,
+                        uint8_t *UAPs, int *results);
+
       /* decode the classic_packet header */
       bool decode_header();
 
@@ -165,13 +195,22 @@ namespace gr {
       uint8_t  d_MD;
       unsigned d_PDU_Length;
 
-      char    d_link_symbols[LE_MAX_SYMBOLS];
       uint8_t d_pdu[LE_MAX_PDU_OCTETS];
 
+      /* CRCInit to check against, known for advertising channels */
+      uint32_t d_crc_init;
+      bool     d_have_crc_init;
+
+      /* the constructor's work after packet's, shared with reset() */
+      void start();
+
     public:
-      le_packet_impl(char *stream, int length, double freq=0.0);
+      le_packet_impl(const symbol_buffer& stream, int offset, int length, double freq=0.0);
       ~le_packet_impl();
 
+      /* reuse for another packet, see packet_pool */
+      void reset(const symbol_buffer& stream, int offset, int length, double freq=0.0);
+
       /* decode the packet header */
       bool decode_header();
       
@@ -190,6 +229,14 @@ namespace gr {
       /* return the low-energy packet's AA */
       uint32_t get_AA() { return d_AA; }
 
+      bool is_advertising() { return d_index >= 37; }
+
+      void set_crc_init(uint32_t crc_init);
+
+      bool connect_req(uint32_t& aa, uint32_t& crc_init);
+
+      bool terminate_ind();
+
       int get_channel( ) { return d_channel; }
     };
 
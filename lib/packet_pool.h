@@ -0,0 +1,180 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_PACKET_POOL_H
+#define INCLUDED_BLUETOOTH_PACKET_POOL_H
+
+#include <gr_bluetooth/symbol_buffer.h>
+#include <gnuradio/thread/thread.h>
+#include <boost/shared_ptr.hpp>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * Recycles packet objects, so that making one for every access code
+     * found stays off the heap once the pool has warmed up.  A packet
+     * handed out by make() goes back to the pool when its last shared
+     * pointer is dropped, keeping the capacity of its buffers, and is
+     * reset() for the next stream that needs one.  The shared pointer
+     * control blocks are recycled the same way.  Up to MAX_FREE packets
+     * wait to be reused; any more are deleted.
+     *
+     * Pools are never destroyed, as packets may still be queued when
+     * static objects go away at exit.
+     */
+    template <class T>
+    class packet_pool
+    {
+    public:
+      static const size_t MAX_FREE = 256;
+
+    private:
+      gr::thread::mutex   d_mutex;
+      std::vector<T *>    d_free;
+
+      /* spare control blocks, all d_block_size bytes */
+      std::vector<void *> d_blocks;
+      size_t              d_block_size;
+
+      packet_pool() : d_block_size(0)
+      {
+        d_free.reserve(MAX_FREE);
+        d_blocks.reserve(MAX_FREE);
+      }
+
+      /* shared_ptr deleter handing the packet back */
+      struct recycler {
+        void operator()(T *pkt) const { instance().put(pkt); }
+      };
+
+      /* shared_ptr control block allocator drawing on d_blocks */
+      template <class U>
+      struct block_allocator {
+        typedef U              value_type;
+        typedef U*             pointer;
+        typedef const U*       const_pointer;
+        typedef U&             reference;
+        typedef const U&       const_reference;
+        typedef size_t         size_type;
+        typedef std::ptrdiff_t difference_type;
+
+        template <class V> struct rebind { typedef block_allocator<V> other; };
+
+        block_allocator() {}
+        template <class V> block_allocator(const block_allocator<V>&) {}
+
+        pointer allocate(size_type n, const void * = 0)
+        {
+          return static_cast<pointer>(instance().get_block(n * sizeof(U)));
+        }
+        void deallocate(pointer p, size_type n)
+        {
+          instance().put_block(p, n * sizeof(U));
+        }
+        void construct(pointer p, const U& value) { new (p) U(value); }
+        void destroy(pointer p) { p->~U(); }
+        size_type max_size() const { return size_t(-1) / sizeof(U); }
+
+        template <class V> bool operator==(const block_allocator<V>&) const { return true; }
+        template <class V> bool operator!=(const block_allocator<V>&) const { return false; }
+      };
+
+      void *get_block(size_t size)
+      {
+        {
+          gr::thread::scoped_lock lock(d_mutex);
+          if (d_block_size == 0) {
+            d_block_size = size;
+          }
+          if ((size == d_block_size) && !d_blocks.empty()) {
+            void *block = d_blocks.back();
+            d_blocks.pop_back();
+            return block;
+          }
+        }
+        return ::operator new(size);
+      }
+
+      void put_block(void *block, size_t size)
+      {
+        {
+          gr::thread::scoped_lock lock(d_mutex);
+          if ((size == d_block_size) && (d_blocks.size() < MAX_FREE)) {
+            d_blocks.push_back(block);
+            return;
+          }
+        }
+        ::operator delete(block);
+      }
+
+      void put(T *pkt)
+      {
+        {
+          gr::thread::scoped_lock lock(d_mutex);
+          if (d_free.size() < MAX_FREE) {
+            d_free.push_back(pkt);
+            return;
+          }
+        }
+        delete pkt;
+      }
+
+    public:
+      static packet_pool& instance()
+      {
+        static packet_pool *pool = new packet_pool();
+        return *pool;
+      }
+
+      /*
+       * A packet for length symbols of stream from offset, recycled if
+       * one is free.  S is the public shared pointer type to return.
+       */
+      template <class S>
+      S make(const symbol_buffer& stream, int offset, int length, double freq=0.0)
+      {
+        T *pkt = NULL;
+        {
+          gr::thread::scoped_lock lock(d_mutex);
+          if (!d_free.empty()) {
+            pkt = d_free.back();
+            d_free.pop_back();
+          }
+        }
+        if (pkt) {
+          pkt->reset(stream, offset, length, freq);
+        }
+        else {
+          pkt = new T(stream, offset, length, freq);
+        }
+        return S(pkt, recycler(), block_allocator<T>());
+      }
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_PACKET_POOL_H */
@@ -29,30 +29,156 @@
 
 #include <gnuradio/io_signature.h>
 #include "piconet_impl.h"
+#include "worker_pool.h"
+#include <boost/bind.hpp>
 #include <stdio.h>
+#include <algorithm>
 
 namespace gr {
   namespace bluetooth {
 
+    piconet::piconet()
+      : d_pkt_queue(DEFAULT_QUEUE_SIZE),
+        d_queue_times(DEFAULT_QUEUE_SIZE),
+        d_queue_head(0),
+        d_queue_count(0),
+        d_queue_max_age(DEFAULT_QUEUE_AGE),
+        d_queue_overflows(0),
+        d_queue_expired(0)
+    {
+    }
+
+    void piconet::drop_head()
+    {
+      d_pkt_queue[d_queue_head].reset();
+      d_queue_head = (d_queue_head + 1) % d_pkt_queue.size();
+      d_queue_count--;
+    }
+
     /* add a packet to the queue */
-    void piconet::enqueue(packet::sptr pkt) {
-      d_pkt_queue.push_back(pkt);
+    void piconet::enqueue(packet::sptr pkt, uint32_t time) {
+      int size = d_pkt_queue.size();
+
+      /* CLKN is 27 bits, so ages are too */
+      while (d_queue_max_age && d_queue_count &&
+             (((time - d_queue_times[d_queue_head]) & 0x7ffffff) > d_queue_max_age)) {
+        drop_head();
+        d_queue_expired++;
+      }
+      if (d_queue_count == size) {
+        drop_head();
+        d_queue_overflows++;
+      }
+
+      int tail = (d_queue_head + d_queue_count) % size;
+      d_pkt_queue[tail] = pkt;
+      d_queue_times[tail] = time;
+      d_queue_count++;
     }
 
     /* pull the first packet from the queue (FIFO) */
     packet::sptr piconet::dequeue( ) {
       packet::sptr pkt;
       
-      if (d_pkt_queue.size() > 0) {
-        pkt = d_pkt_queue.front();
-        d_pkt_queue.erase(d_pkt_queue.begin());
+      if (d_queue_count > 0) {
+        pkt = d_pkt_queue[d_queue_head];
+        drop_head();
       }
 
       return pkt;
     }
 
+    void piconet::set_queue_limits(int size, uint32_t max_age)
+    {
+      if (size < 1) {
+        size = 1;
+      }
+
+      /* keep the newest packets that fit, in order */
+      while (d_queue_count > size) {
+        drop_head();
+        d_queue_overflows++;
+      }
+      std::vector<packet::sptr> queue(size);
+      std::vector<uint32_t> times(size);
+      for (int i = 0; i < d_queue_count; i++) {
+        int index = (d_queue_head + i) % d_pkt_queue.size();
+        queue[i] = d_pkt_queue[index];
+        times[i] = d_queue_times[index];
+      }
+      d_pkt_queue.swap(queue);
+      d_queue_times.swap(times);
+      d_queue_head = 0;
+      d_queue_max_age = max_age;
+    }
+
     // ---------------------------------------------------------------------
 
+    /* 5 bit permutation */
+    /* assumes z is constrained to 5 bits, p_high to 5 bits, p_low to 9 bits */
+    static int perm5(int z, int p_high, int p_low)
+    {
+      int i, tmp, output, z_bit[5], p[14];
+      int index1[] = {0, 2, 1, 3, 0, 1, 0, 3, 1, 0, 2, 1, 0, 1};
+      int index2[] = {1, 3, 2, 4, 4, 3, 2, 4, 4, 3, 4, 3, 3, 2};
+
+      /* bits of p_low and p_high are control signals */
+      for (i = 0; i < 9; i++)
+        p[i] = (p_low >> i) & 0x01;
+      for (i = 0; i < 5; i++)
+        p[i+9] = (p_high >> i) & 0x01;
+
+      /* bit swapping will be easier with an array of bits */
+      for (i = 0; i < 5; i++)
+        z_bit[i] = (z >> i) & 0x01;
+
+      /* butterfly operations */
+      for (i = 13; i >= 0; i--) {
+        /* swap bits according to index arrays if control signal tells us to */
+        if (p[i]) {
+          tmp = z_bit[index1[i]];
+          z_bit[index1[i]] = z_bit[index2[i]];
+          z_bit[index2[i]] = tmp;
+        }
+      }
+
+      /* reconstruct output from rearranged bits */
+      output = 0;
+      for (i = 0; i < 5; i++)
+        output += z_bit[i] << i;
+
+      return(output);
+    }
+
+    /*
+     * perm5() for all possible inputs, the same for every piconet, so
+     * built once at load.  The butterflies p_high controls all come
+     * before those of p_low, so each entry is two smaller lookups.
+     */
+    struct perm_table {
+      char perm[0x20][0x20][0x200];
+
+      perm_table()
+      {
+        int z, p_high, p_low;
+        char high[0x20][0x20];
+        char low[0x20][0x200];
+
+        for (z = 0; z < 0x20; z++) {
+          for (p_high = 0; p_high < 0x20; p_high++)
+            high[z][p_high] = perm5(z, p_high, 0);
+          for (p_low = 0; p_low < 0x200; p_low++)
+            low[z][p_low] = perm5(z, 0, p_low);
+        }
+        for (z = 0; z < 0x20; z++)
+          for (p_high = 0; p_high < 0x20; p_high++)
+            for (p_low = 0; p_low < 0x200; p_low++)
+              perm[z][p_high][p_low] = low[(int) high[z][p_high]][p_low];
+      }
+    };
+
+    static const perm_table PERM_TABLE;
+
     basic_rate_piconet::sptr
     basic_rate_piconet::make(uint32_t LAP)
     {
@@ -88,34 +214,28 @@ namespace gr {
     {
       if(d_hop_reversal_inited) {
         free(d_clock_candidates);
-        free(d_sequence);
       }
     }
 
     /* initialize the hop reversal process */
     int basic_rate_piconet_impl::init_hop_reversal(bool aliased)
     {
-      int max_candidates;
       uint32_t clock;
 
-      printf("\nCalculating complete hopping sequence.\n");
+      printf("\nCalculating initial CLK1-27 candidates.\n");
 
       if (aliased) {
-        max_candidates = (SEQUENCE_LENGTH / ALIASED_CHANNELS) / 32;
+        d_max_candidates = (SEQUENCE_LENGTH / ALIASED_CHANNELS) / 32;
       }
       else {
-        max_candidates = (SEQUENCE_LENGTH / CHANNELS) / 32;
+        d_max_candidates = (SEQUENCE_LENGTH / CHANNELS) / 32;
       }
 		
       /* this can hold twice the approximate number of initial candidates */
-      d_clock_candidates = (uint32_t*) malloc(sizeof(uint32_t) * max_candidates);
-
-      /* this holds the entire hopping sequence */
-      d_sequence = (char*) malloc(SEQUENCE_LENGTH);
+      d_clock_candidates = (uint32_t*) malloc(sizeof(uint32_t) * d_max_candidates);
 
       precalc();
       address_precalc(((d_UAP<<24) | d_LAP) & 0xfffffff);
-      gen_hops();
       clock = (d_clk_offset + d_first_pkt_time) & 0x3f;
       d_num_candidates = init_candidates(d_pattern_channels[0], clock);
       d_winnowed = 0;
@@ -132,24 +252,17 @@ namespace gr {
     void basic_rate_piconet_impl::precalc()
     {
       int i;
-      int z, p_high, p_low;
 
       /* populate frequency register bank*/
       for (i = 0; i < CHANNELS; i++)
         d_bank[i] = ((i * 2) % CHANNELS);
       /* actual frequency is 2402 + d_bank[i] MHz */
-
-      /* populate perm_table for all possible inputs */
-      for (z = 0; z < 0x20; z++)
-        for (p_high = 0; p_high < 0x20; p_high++)
-          for (p_low = 0; p_low < 0x200; p_low++)
-            d_perm_table[z][p_high][p_low] = perm5(z, p_high, p_low);
     }
 
     /* do precalculation that requires the address */
     void basic_rate_piconet_impl::address_precalc(int address)
     {
-      /* precalculate some of single_hop()/gen_hop()'s variables */
+      /* precalculate some of single_hop()'s variables */
       d_a1 = (address >> 23) & 0x1f;
       d_b = (address >> 19) & 0x0f;
       d_c1 = ((address >> 4) & 0x10) +
@@ -170,92 +283,10 @@ namespace gr {
     /* drop-in replacement for perm5() using lookup table */
     int basic_rate_piconet_impl::fast_perm(int z, int p_high, int p_low)
     {
-      return(d_perm_table[z][p_high][p_low]);
-    }
-
-    
-    /* 5 bit permutation */
-    /* assumes z is constrained to 5 bits, p_high to 5 bits, p_low to 9 bits */
-    int basic_rate_piconet_impl::perm5(int z, int p_high, int p_low)
-    {
-      int i, tmp, output, z_bit[5], p[14];
-      int index1[] = {0, 2, 1, 3, 0, 1, 0, 3, 1, 0, 2, 1, 0, 1};
-      int index2[] = {1, 3, 2, 4, 4, 3, 2, 4, 4, 3, 4, 3, 3, 2};
-
-      /* bits of p_low and p_high are control signals */
-      for (i = 0; i < 9; i++)
-        p[i] = (p_low >> i) & 0x01;
-      for (i = 0; i < 5; i++)
-        p[i+9] = (p_high >> i) & 0x01;
-
-      /* bit swapping will be easier with an array of bits */
-      for (i = 0; i < 5; i++)
-        z_bit[i] = (z >> i) & 0x01;
-
-      /* butterfly operations */
-      for (i = 13; i >= 0; i--) {
-        /* swap bits according to index arrays if control signal tells us to */
-        if (p[i]) {
-          tmp = z_bit[index1[i]];
-          z_bit[index1[i]] = z_bit[index2[i]];
-          z_bit[index2[i]] = tmp;
-        }
-      }
-
-      /* reconstruct output from rearranged bits */
-      output = 0;
-      for (i = 0; i < 5; i++)
-        output += z_bit[i] << i;
-
-      return(output);
-    }
-
-    /* generate the complete hopping sequence */
-    void basic_rate_piconet_impl::gen_hops()
-    {
-      /* a, b, c, d, e, f, x, y1, y2 are variable names used in section 2.6 of the spec */
-      /* b is already defined */
-      /* e is already defined */
-      int a, c, d, f, x;
-      int h, i, j, k, c_flipped, perm_in, perm_out;
-
-      /* sequence index = clock >> 1 */
-      /* (hops only happen at every other clock value) */
-      int index = 0;
-      f = 0;
-
-      /* nested loops for optimization (not recalculating every variable with every clock tick) */
-      for (h = 0; h < 0x04; h++) { /* clock bits 26-27 */
-        for (i = 0; i < 0x20; i++) { /* clock bits 21-25 */
-          a = d_a1 ^ i;
-          for (j = 0; j < 0x20; j++) { /* clock bits 16-20 */
-            c = d_c1 ^ j;
-            c_flipped = c ^ 0x1f;
-            for (k = 0; k < 0x200; k++) { /* clock bits 7-15 */
-              d = d_d1 ^ k;
-              for (x = 0; x < 0x20; x++) { /* clock bits 2-6 */
-                perm_in = ((x + a) % 32) ^ d_b;
-                /* y1 (clock bit 1) = 0, y2 = 0 */
-                perm_out = fast_perm(perm_in, c, d);
-                d_sequence[index] = d_bank[(perm_out + d_e + f) % CHANNELS];
-                if (d_afh) {
-                  d_sequence[index + 1] = d_sequence[index];
-                } else {
-                  /* y1 (clock bit 1) = 1, y2 = 32 */
-                  perm_out = fast_perm(perm_in, c_flipped, d);
-                  d_sequence[index + 1] = d_bank[(perm_out + d_e + f + 32) % CHANNELS];
-                }
-                index += 2;
-              }
-              f += 16;
-            }
-          }
-        }
-      }
+      return(PERM_TABLE.perm[z][p_high][p_low]);
     }
 
     /* determine channel for a particular hop */
-    /* replaced with gen_hops() for a complete sequence but could still come in handy */
     char basic_rate_piconet_impl::single_hop(int clock)
     {
       int a, c, d, f, x, y1, y2;
@@ -275,28 +306,106 @@ namespace gr {
       return(d_bank[(fast_perm(((x + a) % 32) ^ d_b, (y1 * 0x1f) ^ c, d) + d_e + f + y2) % CHANNELS]);
     }
 
-    /* look up channel for a particular hop */
+    /* look up channel for a particular hop, with AFH the odd hops repeat the even ones */
     char basic_rate_piconet_impl::hop(int clock)
     {
-      return d_sequence[clock];
+      uint32_t mask = d_afh ? 0x7fffffe : 0x7ffffff;
+
+      return single_hop((clock & mask) << 1);
+    }
+
+    /* blocks of the sequence sharing CLK16-27, and how many chunks of
+     * them are scanned in parallel for the initial candidates */
+    static const int CANDIDATE_BLOCKS = 0x1000;
+    static const int CANDIDATE_CHUNKS = 64;
+
+    /*
+     * Threads shared by every piconet for the initial candidate scan,
+     * one scan at a time.  Never destroyed, like the packet pools.
+     */
+    static gr::thread::mutex hop_workers_mutex;
+
+    static worker_pool& hop_workers()
+    {
+      static worker_pool *pool =
+        new worker_pool(worker_pool::default_nthreads(CANDIDATE_CHUNKS));
+      return *pool;
+    }
+
+    /*
+     * Find the candidates in one chunk of the sequence, for found[chunk].
+     * CLK1-6 are known, so within a block of CLK16-27 only d (CLK7-15)
+     * and f vary from one candidate to the next: each is a step along one
+     * row of the perm table, and the channel is a lookup in match[],
+     * which says whether each value of (perm_out + e + f + y2) % CHANNELS
+     * would be seen as the observed channel.
+     */
+    void basic_rate_piconet_impl::scan_candidates(int chunk, const bool *match,
+                                                  int known_clock_bits,
+                                                  std::vector<uint32_t> *found)
+    {
+      int block, k, x, y1, a, c, r, v, perm_in;
+      const char *row;
+      std::vector<uint32_t>& out = found[chunk];
+
+      /* CLK1 is always 0 with AFH as each hop is repeated */
+      x = (known_clock_bits >> 1) & 0x1f;
+      y1 = d_afh ? 0 : known_clock_bits & 0x01;
+
+      out.clear();
+      for (block = chunk * CANDIDATE_BLOCKS / CANDIDATE_CHUNKS;
+           block < (chunk + 1) * CANDIDATE_BLOCKS / CANDIDATE_CHUNKS; block++) {
+        a = (d_a1 ^ (block >> 5)) & 0x1f;
+        c = (d_c1 ^ block) & 0x1f;
+        perm_in = ((x + a) % 32) ^ d_b;
+        row = PERM_TABLE.perm[perm_in][(y1 * 0x1f) ^ c];
+
+        /* f = 16 * CLK7-27, stepping by 16 each time round */
+        r = ((block << 13) + d_e + (y1 << 5)) % CHANNELS;
+        for (k = 0; k < 0x200; k++) {
+          v = row[d_d1 ^ k] + r;
+          if (v >= CHANNELS)
+            v -= CHANNELS;
+          if (match[v])
+            out.push_back((block << 15) | (k << 6) | known_clock_bits);
+          r += 16;
+          if (r >= CHANNELS)
+            r -= CHANNELS;
+        }
+      }
     }
 
     /* create list of initial candidate clock values (hops with same channel as first observed hop) */
     int basic_rate_piconet_impl::init_candidates(char channel, int known_clock_bits)
     {
-      int i;
+      int i, n;
       int count = 0; /* total number of candidates */
       char observable_channel; /* accounts for aliasing if necessary */
+      bool match[CHANNELS];
+      std::vector<uint32_t> found[CANDIDATE_CHUNKS];
 
-      /* only try clock values that match our known bits */
-      for (i = known_clock_bits; i < SEQUENCE_LENGTH; i += 0x40) {
+      for (i = 0; i < CHANNELS; i++) {
         if (d_aliased)
-          observable_channel = aliased_channel(d_sequence[i]);
+          observable_channel = aliased_channel(d_bank[i]);
         else
-          observable_channel = d_sequence[i];
-        if (observable_channel == channel)
-          d_clock_candidates[count++] = i;
-        //FIXME ought to throw exception if count gets too big
+          observable_channel = d_bank[i];
+        match[i] = (observable_channel == channel);
+      }
+
+      /* only try clock values that match our known bits */
+      {
+        gr::thread::scoped_lock lock(hop_workers_mutex);
+        hop_workers().parallel_for(CANDIDATE_CHUNKS,
+                                   boost::bind(&basic_rate_piconet_impl::scan_candidates,
+                                               this, _1, match, known_clock_bits,
+                                               found));
+      }
+
+      /* keep them in clock order, as many as there is room for */
+      for (i = 0; i < CANDIDATE_CHUNKS; i++) {
+        n = std::min((int) found[i].size(), d_max_candidates - count);
+        std::copy(found[i].begin(), found[i].begin() + n, d_clock_candidates + count);
+        count += n;
       }
       return count;
     }
@@ -304,22 +413,47 @@ namespace gr {
     /* narrow a list of candidate clock values based on a single observed hop */
     int basic_rate_piconet_impl::winnow(int offset, char channel)
     {
-      int i;
+      uint8_t observed = channel;
+
+      return winnow(&offset, &observed, 1);
+    }
+
+    /*
+     * Narrow the candidates on up to WINNOW_HOPS observed hops in one
+     * pass.  match[h] says which channels (0-78) would be seen as the
+     * observed channel of hop h, so aliasing costs nothing per
+     * candidate, and most candidates are dropped by the first hop.
+     */
+    int basic_rate_piconet_impl::winnow(const int *offsets, const uint8_t *channels,
+                                        int count)
+    {
+      int i, h, keep;
       int new_count = 0; /* number of candidates after winnowing */
       char observable_channel; /* accounts for aliasing if necessary */
+      bool match[WINNOW_HOPS][CHANNELS];
+      uint32_t candidate;
+      uint32_t mask = d_afh ? 0x7fffffe : 0x7ffffff;
+
+      for (h = 0; h < count; h++) {
+        for (i = 0; i < CHANNELS; i++) {
+          if (d_aliased)
+            observable_channel = aliased_channel(i);
+          else
+            observable_channel = i;
+          match[h][i] = (observable_channel == channels[h]);
+        }
+      }
 
-      /* check every candidate */
+      /* check every candidate, computing only the hops still needed */
       for (i = 0; i < d_num_candidates; i++) {
-        if (d_aliased)
-          observable_channel = aliased_channel(d_sequence[(d_clock_candidates[i] + offset) % SEQUENCE_LENGTH]);
-        else
-          observable_channel = d_sequence[(d_clock_candidates[i] + offset) % SEQUENCE_LENGTH];
-        if (observable_channel == channel) {
-          /* this candidate matches the latest hop */
-          /* blow away old list of candidates with new one */
-          /* safe because new_count can never be greater than i */
-          d_clock_candidates[new_count++] = d_clock_candidates[i];
-        }
+        candidate = d_clock_candidates[i];
+        keep = 1;
+        for (h = 0; keep && (h < count); h++)
+          keep = match[h][(int) single_hop(((candidate + offsets[h]) & mask) << 1)];
+        /* blow away old list of candidates with new one */
+        /* safe because new_count can never be greater than i */
+        d_clock_candidates[new_count] = candidate;
+        new_count += keep;
       }
       d_num_candidates = new_count;
 
@@ -341,15 +475,19 @@ namespace gr {
     int basic_rate_piconet_impl::winnow()
     {
       int new_count = d_num_candidates;
-      int index, last_index;
+      int index, last_index, first, count;
       uint8_t channel, last_channel;
 
-      for (; d_winnowed < d_packets_observed; d_winnowed++) {
-        index = d_pattern_indices[d_winnowed];
-        channel = d_pattern_channels[d_winnowed];
-        new_count = winnow(index, channel);
+      /* all the hops not yet used, a batch per pass over the candidates */
+      while (d_winnowed < d_packets_observed) {
+        first = d_winnowed;
+        count = std::min(WINNOW_HOPS, d_packets_observed - first);
 
-        if (d_packets_observed > 0) {
+        for (; d_winnowed < first + count; d_winnowed++) {
+          if (d_winnowed == 0)
+            continue;
+          index = d_pattern_indices[d_winnowed];
+          channel = d_pattern_channels[d_winnowed];
           last_index = d_pattern_indices[d_winnowed - 1];
           last_channel = d_pattern_channels[d_winnowed - 1];
           /*
@@ -362,6 +500,9 @@ namespace gr {
               && (channel == last_channel))
             d_looks_like_afh = true;
         }
+
+        new_count = winnow(&d_pattern_indices[first],
+                           &d_pattern_channels[first], count);
       }
 	
       return new_count;
@@ -453,20 +594,34 @@ namespace gr {
       d_packets_observed++;
       d_total_packets_observed++;
 
-      /* try every possible first packet clock value */
+      /* every possible first packet clock value still in the running */
+      uint64_t clocks = 0;
+      int want_UAP[64];
+      uint8_t UAPs[64];
+      int results[64];
+
       for (count = 0; count < 64; count++) {
         /* skip eliminated candidates unless this is our first time through */
         if (d_clock6_candidates[count] > -1 || !d_got_first_packet) {
           /* clock value for the current packet assuming count was the clock of the first packet */
           int clock = (count + clkn - d_first_pkt_time) % 64;
-          starting++;
-          UAP = packet->try_clock(clock);
-          retval = -1;
+          clocks |= UINT64_C(1) << clock;
 
           /* if this is the first packet: populate the candidate list */
           /* if not: check CRCs if UAPs match */
-          if (!d_got_first_packet || UAP == d_clock6_candidates[count])
-            retval = packet->crc_check(clock);
+          want_UAP[clock] = d_got_first_packet ? d_clock6_candidates[count] : -1;
+        }
+      }
+
+      /* one pass over the packet for all of them */
+      packet->check_clocks(clocks, want_UAP, UAPs, results);
+
+      for (count = 0; count < 64; count++) {
+        if (d_clock6_candidates[count] > -1 || !d_got_first_packet) {
+          int clock = (count + clkn - d_first_pkt_time) % 64;
+          starting++;
+          UAP = UAPs[clock];
+          retval = results[clock];
 
           switch(retval) {
 
@@ -529,7 +684,6 @@ namespace gr {
 
       if(d_hop_reversal_inited) {
         free(d_clock_candidates);
-        free(d_sequence);
       }
       d_got_first_packet = false;
       d_packets_observed = 0;
@@ -557,7 +711,9 @@ namespace gr {
     // ---------------------------------------------------------------------
 
     low_energy_piconet_impl::low_energy_piconet_impl(uint32_t aa) {
-      // TODO
+      d_AA = aa;
+      d_crc_init = 0;
+      d_have_crc_init = false;
     }
 
     low_energy_piconet_impl::~low_energy_piconet_impl( ) {
@@ -583,6 +739,19 @@ namespace gr {
       // TODO
     }
 
+    uint32_t low_energy_piconet_impl::get_crc_init( ) {
+      return d_crc_init;
+    }
+
+    void low_energy_piconet_impl::set_crc_init(uint32_t crc_init) {
+      d_crc_init = crc_init & 0xffffff;
+      d_have_crc_init = true;
+    }
+
+    bool low_energy_piconet_impl::have_crc_init( ) {
+      return d_have_crc_init;
+    }
+
   } /* namespace bluetooth */
 } /* namespace gr */
 
@@ -44,6 +44,9 @@ namespace gr {
       /* maximum number of hops to remember */
       static const int MAX_PATTERN_LENGTH = 1000;
 
+      /* most observed hops to winnow on in one pass over the candidates */
+      static const int WINNOW_HOPS = 16;
+
       /* true if using a particular aliased receiver implementation */
       bool d_aliased;
 
@@ -65,6 +68,9 @@ namespace gr {
       /* CLK1-27 candidates */
       uint32_t *d_clock_candidates;
 
+      /* room in d_clock_candidates */
+      int d_max_candidates;
+
       /* these values for hop() can be precalculated */
       int d_b, d_e;
 
@@ -75,12 +81,6 @@ namespace gr {
       /* frequency register bank */
       int d_bank[CHANNELS];
 
-      /* speed up the perm5 function with a lookup table */
-      char d_perm_table[0x20][0x20][0x200];
-
-      /* this holds the entire hopping sequence */
-      char *d_sequence;
-
       /* number of candidates for CLK1-27 */
       int d_num_candidates;
 
@@ -114,20 +114,19 @@ namespace gr {
       /* drop-in replacement for perm5() using lookup table */
       int fast_perm(int z, int p_high, int p_low);
 
-      /* 5 bit permutation */
-      /* assumes z is constrained to 5 bits, p_high to 5 bits, p_low to 9 bits */
-      int perm5(int z, int p_high, int p_low);
-
-      /* generate the complete hopping sequence */
-      void gen_hops();
-
-      /* determine channel for a particular hop */
-      /* replaced with gen_hops() for a complete sequence but could still come in handy */
+      /* determine channel for a particular hop (clock is CLK0-27) */
       char single_hop(int clock);
 
       /* create list of initial candidate clock values (hops with same channel as first observed hop) */
       int init_candidates(char channel, int known_clock_bits);
 
+      /* narrow the candidates based on several observed hops at once */
+      int winnow(const int *offsets, const uint8_t *channels, int count);
+
+      /* collect the candidates in one chunk of the sequence into found[chunk] */
+      void scan_candidates(int chunk, const bool *match, int known_clock_bits,
+                           std::vector<uint32_t> *found);
+
       /* discovery status */
       bool d_have_UAP;
       bool d_have_NAP;
@@ -188,11 +187,22 @@ namespace gr {
     class low_energy_piconet_impl : public low_energy_piconet {
     private:
       uint8_t  d_chan_list[38];
+
+      /* access address of the connection */
+      uint32_t d_AA;
+
+      /* CRCInit of the connection */
+      uint32_t d_crc_init;
+      bool     d_have_crc_init;
       
     public:
       low_energy_piconet_impl(uint32_t aa);
       ~low_energy_piconet_impl();
 
+      uint32_t get_crc_init();
+      void set_crc_init(uint32_t crc_init);
+      bool have_crc_init();
+
       int init_hop_reversal(bool aliased);
       char hop(int clock);
       char aliased_channel(char channel);
@@ -0,0 +1,52 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "power.h"
+#include <volk/volk.h>
+#include <limits>
+
+namespace gr {
+  namespace bluetooth {
+
+    double
+    mean_power(const gr_complex *in, int n)
+    {
+      /* as 0/0 did, so that an SNR taken from it never passes */
+      if (n <= 0) {
+        return std::numeric_limits<double>::quiet_NaN();
+      }
+
+      /* x . conj(x) is the sum of |x|^2, and VOLK has a fast kernel for it */
+      lv_32fc_t sum;
+      volk_32fc_x2_conjugate_dot_prod_32fc(&sum, in, in, n);
+      return (double) sum.real() / n;
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
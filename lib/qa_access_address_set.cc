@@ -0,0 +1,146 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "qa_access_address_set.h"
+#include "gr_bluetooth/access_address_set.h"
+#include <cppunit/TestAssert.h>
+#include <stdlib.h>
+#include <set>
+
+namespace gr {
+  namespace bluetooth {
+
+    /* home slot of aa in the 64 slot table a new set starts with */
+    static unsigned
+    home_slot(uint32_t aa)
+    {
+      return (aa * 0x9e3779b1u) >> 26;
+    }
+
+    /* count access addresses from start whose home slot is slot */
+    static void
+    find_homes(std::vector<uint32_t>& out, unsigned slot, int count, uint32_t start)
+    {
+      for (uint32_t aa = start; count > 0; aa++) {
+        if (home_slot(aa) == slot) {
+          out.push_back(aa);
+          count--;
+        }
+      }
+    }
+
+    void
+    qa_access_address_set::t1()
+    {
+      access_address_set aas;
+
+      CPPUNIT_ASSERT(!aas.insert(0));
+      CPPUNIT_ASSERT(aas.empty());
+      CPPUNIT_ASSERT(!aas.contains(0));
+      CPPUNIT_ASSERT(!aas.erase(0));
+
+      /* 0 must not match an empty slot once the table has entries */
+      for (uint32_t aa = 1; aa <= 40; aa++)
+        CPPUNIT_ASSERT(aas.insert(aa));
+      CPPUNIT_ASSERT(!aas.insert(0));
+      CPPUNIT_ASSERT(!aas.contains(0));
+      CPPUNIT_ASSERT(!aas.erase(0));
+      CPPUNIT_ASSERT_EQUAL(40, aas.size());
+    }
+
+    void
+    qa_access_address_set::t2()
+    {
+      access_address_set aas;
+      std::set<uint32_t> ref;
+      std::vector<uint32_t> added;
+
+      srandom(20);
+      while (ref.size() < 1000) {
+        uint32_t aa = random() | 1;
+        bool fresh = ref.insert(aa).second;
+        CPPUNIT_ASSERT_EQUAL(fresh, aas.insert(aa));
+        if (fresh)
+          added.push_back(aa);
+
+        /* everything so far is still there after each rehash */
+        CPPUNIT_ASSERT_EQUAL((int) ref.size(), aas.size());
+        if ((ref.size() & (ref.size() - 1)) == 0) {
+          for (std::set<uint32_t>::iterator it = ref.begin(); it != ref.end(); it++)
+            CPPUNIT_ASSERT(aas.contains(*it));
+        }
+      }
+      for (int i = 0; i < 1000; i++)
+        CPPUNIT_ASSERT(!aas.contains(random() & ~1u));
+
+      /* take every other one out, then put them back */
+      for (unsigned i = 0; i < added.size(); i += 2) {
+        CPPUNIT_ASSERT(aas.erase(added[i]));
+        CPPUNIT_ASSERT(!aas.erase(added[i]));
+      }
+      CPPUNIT_ASSERT_EQUAL(500, aas.size());
+      for (unsigned i = 0; i < added.size(); i++)
+        CPPUNIT_ASSERT_EQUAL((i & 1) != 0, aas.contains(added[i]));
+      for (unsigned i = 0; i < added.size(); i += 2)
+        CPPUNIT_ASSERT(aas.insert(added[i]));
+      for (unsigned i = 0; i < added.size(); i++)
+        CPPUNIT_ASSERT(aas.contains(added[i]));
+    }
+
+    void
+    qa_access_address_set::t3()
+    {
+      /* a run from the last slot round into the first ones */
+      std::vector<uint32_t> run;
+      find_homes(run, 62, 1, 1);
+      find_homes(run, 63, 4, 1);
+      find_homes(run, 0, 2, 1);
+      find_homes(run, 1, 1, 1);
+
+      for (unsigned victim = 0; victim < run.size(); victim++) {
+        access_address_set aas;
+        for (unsigned i = 0; i < run.size(); i++)
+          CPPUNIT_ASSERT(aas.insert(run[i]));
+
+        /* erase starting from each entry, then the rest in turn */
+        for (unsigned n = 0; n < run.size(); n++) {
+          unsigned gone = (victim + n) % run.size();
+          CPPUNIT_ASSERT(aas.erase(run[gone]));
+          CPPUNIT_ASSERT_EQUAL((int) (run.size() - n - 1), aas.size());
+          for (unsigned i = 0; i < run.size(); i++) {
+            bool erased = ((i + run.size() - victim) % run.size()) <= n;
+            CPPUNIT_ASSERT_EQUAL(!erased, aas.contains(run[i]));
+          }
+        }
+        CPPUNIT_ASSERT(aas.empty());
+      }
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
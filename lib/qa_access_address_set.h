@@ -0,0 +1,56 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _QA_ACCESS_ADDRESS_SET_H_
+#define _QA_ACCESS_ADDRESS_SET_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace bluetooth {
+
+    class qa_access_address_set : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_access_address_set);
+      CPPUNIT_TEST(t1);
+      CPPUNIT_TEST(t2);
+      CPPUNIT_TEST(t3);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      /* 0 is never a member */
+      void t1();
+      /* insert, erase and contains as the table grows */
+      void t2();
+      /* erase from probe runs that wrap past the end of the table */
+      void t3();
+    };
+
+  } /* namespace bluetooth */
+} /* namespace gr */
+
+#endif /* _QA_ACCESS_ADDRESS_SET_H_ */
@@ -26,11 +26,16 @@
  */
 
 #include "qa_bluetooth.h"
+#include "qa_packet.h"
+#include "qa_access_address_set.h"
 
 CppUnit::TestSuite *
 qa_bluetooth::suite()
 {
   CppUnit::TestSuite *s = new CppUnit::TestSuite("bluetooth");
 
+  s->addTest(gr::bluetooth::qa_packet::suite());
+  s->addTest(gr::bluetooth::qa_access_address_set::suite());
+
   return s;
 }
@@ -0,0 +1,213 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "qa_packet.h"
+#include "gr_bluetooth/packet.h"
+#include <cppunit/TestAssert.h>
+#include <stdlib.h>
+
+namespace gr {
+  namespace bluetooth {
+
+    /* the payload CRC one air order bit at a time, as crcgen() used to be */
+    static uint16_t
+    crcgen_bits(const char *payload, int length, int UAP)
+    {
+      uint16_t reg = (packet::reverse(UAP) << 8) & 0xff00;
+
+      for (int count = 0; count < length; count++) {
+        reg = (reg >> 1) | (((reg & 0x0001) ^ (payload[count] & 0x01)) << 15);
+        reg ^= ((reg & 0x8000) >> 5);
+        reg ^= ((reg & 0x8000) >> 12);
+      }
+      return reg;
+    }
+
+    static void
+    random_bits(char *bits, int length)
+    {
+      for (int i = 0; i < length; i++)
+        bits[i] = random() & 1;
+    }
+
+    /*
+     * LE PDUs (header and payload) with the CRC the spec's bit serial
+     * LFSR gives them, cross-checked by polynomial division.
+     */
+    static const uint8_t ADV_IND[15] = {
+      0x40, 0x0d, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66,
+      0x02, 0x01, 0x06, 0x03, 0x09, 0x47, 0x52
+    };
+    static const uint32_t ADV_IND_CRC = 0xca146b;
+
+    static const uint8_t CONNECT_REQ[36] = {
+      0x05, 0x22, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6,
+      0x11, 0x22, 0x33, 0x44, 0x55, 0x66,
+      0x17, 0x4a, 0x65, 0x50,                   /* AA */
+      0x3c, 0x9a, 0x7d,                         /* CRCInit */
+      0x02, 0x05, 0x00, 0x18, 0x00, 0x00, 0x00, 0x48, 0x00,
+      0xff, 0xff, 0xff, 0xff, 0x1f, 0x25
+    };
+    static const uint32_t CONNECT_REQ_CRC = 0x30dd83;
+    static const uint32_t CONNECT_REQ_AA = 0x50654a17;
+    static const uint32_t CONNECT_REQ_CRC_INIT = 0x7d9a3c;
+
+    static const uint8_t LL_DATA[9] = {
+      0x02, 0x07, 0x03, 0x00, 0x04, 0x00, 0x0a, 0x01, 0x00
+    };
+    static const uint32_t LL_DATA_CRC = 0x785270;
+
+    static void
+    put_bits(char *air, uint32_t value, int n)
+    {
+      for (int i = 0; i < n; i++)
+        air[i] = (value >> i) & 1;
+    }
+
+    /* preamble, AA and the whitened PDU and CRC, in air order */
+    static int
+    le_air(char *air, uint32_t aa, const uint8_t *pdu, int octets, uint32_t crc, double freq)
+    {
+      int index = le_packet::INDICES[le_packet::freq2index(freq)];
+      int length = 40 + 8 * octets + 24;
+
+      put_bits(air, (aa & 1) ? 0x55 : 0xaa, 8);
+      put_bits(&air[8], aa, 32);
+      for (int count = 0; count < octets; count++)
+        put_bits(&air[40 + 8 * count], pdu[count], 8);
+      put_bits(&air[40 + 8 * octets], crc, 24);
+      for (int i = 40; i < length; i++)
+        air[i] ^= packet::WHITENING_DATA[(index + i - 40) % 127];
+      return length;
+    }
+
+    void
+    qa_packet::t1()
+    {
+      for (int data = 0; data < 1024; data++) {
+        for (int hec = 0; hec < 256; hec++) {
+          CPPUNIT_ASSERT_EQUAL(classic_packet::UAP_from_hec_bits(data, hec),
+                               classic_packet::UAP_from_hec(data, hec));
+        }
+      }
+    }
+
+    void
+    qa_packet::t2()
+    {
+      char payload[2800];
+
+      srandom(13);
+      for (int length = 0; length <= 2745; length += 1 + random() % 37) {
+        int UAP = random() & 0xff;
+        random_bits(payload, length);
+        CPPUNIT_ASSERT_EQUAL(crcgen_bits(payload, length, UAP),
+                             classic_packet::crcgen(payload, length, UAP));
+      }
+    }
+
+    void
+    qa_packet::t3()
+    {
+      char payload[2800], whitened[2800];
+
+      srandom(31);
+      for (int trial = 0; trial < 200; trial++) {
+        int clock = random() & 0x3f;
+        int skip = (trial & 1) ? 18 : random() % 127;
+        int length = 16 + random() % 2730;
+        int UAP = random() & 0xff;
+        int index = classic_packet::INDICES[clock] + skip;
+
+        random_bits(payload, length);
+        for (int i = 0; i < length; i++)
+          whitened[i] = payload[i] ^ packet::WHITENING_DATA[(index + i) % 127];
+
+        /* CRC mismatch of the whitened payload is that of the plain one plus whitening_crc() */
+        uint16_t plain = crcgen_bits(payload, length - 16, UAP) ^
+          packet::air_to_host16(&payload[length - 16], 16);
+        uint16_t white = crcgen_bits(whitened, length - 16, UAP) ^
+          packet::air_to_host16(&whitened[length - 16], 16);
+        CPPUNIT_ASSERT_EQUAL((uint16_t) (plain ^ classic_packet::whitening_crc(clock, skip, length)),
+                             white);
+      }
+    }
+
+    void
+    qa_packet::t4()
+    {
+      char air[LE_MAX_SYMBOLS];
+
+      CPPUNIT_ASSERT_EQUAL(ADV_IND_CRC,
+                           le_packet::crcgen(ADV_IND, sizeof(ADV_IND), le_packet::ADVERTISING_CRC_INIT));
+
+      int length = le_air(air, 0x8e89bed6, ADV_IND, sizeof(ADV_IND), ADV_IND_CRC, 2402e6);
+      le_packet::sptr pkt = le_packet::make(air, length, 2402e6);
+      CPPUNIT_ASSERT(pkt->is_advertising());
+      CPPUNIT_ASSERT(pkt->decode_header());
+
+      air[60] ^= 1;
+      pkt = le_packet::make(air, length, 2402e6);
+      CPPUNIT_ASSERT(!pkt->decode_header());
+    }
+
+    void
+    qa_packet::t5()
+    {
+      char air[LE_MAX_SYMBOLS];
+      uint32_t aa, crc_init;
+
+      CPPUNIT_ASSERT_EQUAL(CONNECT_REQ_CRC,
+                           le_packet::crcgen(CONNECT_REQ, sizeof(CONNECT_REQ),
+                                             le_packet::ADVERTISING_CRC_INIT));
+
+      /* AA is at payload offset 12 and CRCInit at 16, both LSB first */
+      int length = le_air(air, 0x8e89bed6, CONNECT_REQ, sizeof(CONNECT_REQ), CONNECT_REQ_CRC, 2426e6);
+      le_packet::sptr pkt = le_packet::make(air, length, 2426e6);
+      CPPUNIT_ASSERT(pkt->decode_header());
+      pkt->decode_payload();
+      CPPUNIT_ASSERT(pkt->connect_req(aa, crc_init));
+      CPPUNIT_ASSERT_EQUAL(CONNECT_REQ_AA, aa);
+      CPPUNIT_ASSERT_EQUAL(CONNECT_REQ_CRC_INIT, crc_init);
+
+      /* crcgen() loads CRCInit bit reversed into its register */
+      CPPUNIT_ASSERT_EQUAL(LL_DATA_CRC, le_packet::crcgen(LL_DATA, sizeof(LL_DATA), crc_init));
+
+      length = le_air(air, aa, LL_DATA, sizeof(LL_DATA), LL_DATA_CRC, 2404e6);
+      pkt = le_packet::make(air, length, 2404e6);
+      CPPUNIT_ASSERT(!pkt->is_advertising());
+      CPPUNIT_ASSERT(!pkt->decode_header());
+      pkt->set_crc_init(crc_init);
+      CPPUNIT_ASSERT(pkt->decode_header());
+      pkt->set_crc_init(le_packet::ADVERTISING_CRC_INIT);
+      CPPUNIT_ASSERT(!pkt->decode_header());
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
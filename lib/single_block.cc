@@ -29,7 +29,8 @@
 
 #include "gr_bluetooth/packet.h"
 #include "gr_bluetooth/single_block.h"
-#include <gnuradio/blocks/complex_to_mag_squared.h>
+#include "power.h"
+#include "symbol_kernels.h"
 #include <gnuradio/filter/firdes.h>
 #include <gnuradio/io_signature.h>
 #include <gnuradio/math.h>
@@ -184,22 +185,13 @@ int single_block::mm_cr(const float* in, int ninput_items, float* out, int noutp
 /* fm demodulation, taken from gr_quadrature_demod_cf */
 void single_block::demod(const gr_complex* in, float* out, int noutput_items)
 {
-    int i;
-    gr_complex product;
-
-    for (i = 1; i < noutput_items; i++) {
-        gr_complex product = in[i] * conj(in[i - 1]);
-        out[i] = d_demod_gain * gr::fast_atan2f(imag(product), real(product));
-    }
+    quadrature_demod(in, out, noutput_items, d_demod_gain);
 }
 
-/* binary slicer, similar to gr_binary_slicer_fb */
-void single_block::slicer(const float* in, char* out, int noutput_items)
+/* binary slicer, similar to gr_binary_slicer_fb, appending to out */
+void single_block::slicer(const float* in, symbol_buffer& out, int noutput_items)
 {
-    int i;
-
-    for (i = 0; i < noutput_items; i++)
-        out[i] = (in[i] < 0) ? 0 : 1;
+    append_sliced(in, noutput_items, out);
 }
 
 int single_block::channel_samples(gr_vector_const_void_star& in,
@@ -218,27 +210,13 @@ int single_block::channel_samples(gr_vector_const_void_star& in,
 
     ddc_noutput_items = d_channel_ddc->work(ddc_noutput_items, ddc_in, out);
 
-    gr::blocks::complex_to_mag_squared::sptr mag2 =
-        gr::blocks::complex_to_mag_squared::make(1);
-
-    float* mag2_out = new float[ddc_noutput_items];
-    gr_vector_void_star mag2_out_vector(1);
-    mag2_out_vector[0] = &mag2_out[0];
-    gr_vector_const_void_star ddc_out_const(1);
-    ddc_out_const[0] = out[0];
-    (void)mag2->work(ddc_noutput_items, ddc_out_const, mag2_out_vector);
-    energy = 0.0;
-    for (unsigned i = 0; i < ddc_noutput_items; i++) {
-        energy += mag2_out[i];
-    }
-    energy /= ddc_noutput_items;
-    delete[] mag2_out;
+    energy = mean_power((const gr_complex*)out[0], ddc_noutput_items);
 
     return ddc_noutput_items;
 }
 
 int single_block::channel_symbols(gr_vector_const_void_star& in,
-                                  char* out,
+                                  symbol_buffer& out,
                                   int ninput_items)
 {
     /* fm demodulation */
@@ -254,9 +232,10 @@ int single_block::channel_symbols(gr_vector_const_void_star& in,
     noutput_items = mm_cr(demod_out, cr_ninput_items, cr_out, noutput_items);
 
     /* binary slicer */
+    out.clear();
     slicer(cr_out, out, noutput_items);
 
-    return noutput_items;
+    return out.size();
 }
 
 bool single_block::check_snr(const double on_channel_energy,
@@ -271,22 +250,11 @@ bool single_block::check_snr(const double on_channel_energy,
         d_noise_ddc->fixed_rate_ninput_to_noutput((int)d_samples_per_slot);
     gr_complex ddc_out[ddc_noutput_items];
     gr_vector_void_star ddc_out_vector(1);
-    gr_vector_const_void_star ddc_out_const(1);
     ddc_out_vector[0] = &ddc_out[0];
-    ddc_out_const[0] = &ddc_out[0];
     ddc_noutput_items = d_noise_ddc->work(ddc_noutput_items, ddc_in, ddc_out_vector);
 
     // average mag2 for valley
-    gr::blocks::complex_to_mag_squared::sptr mag2 =
-        gr::blocks::complex_to_mag_squared::make(1);
-    float mag2_out[ddc_noutput_items];
-    gr_vector_void_star mag2_out_vector(1);
-    mag2_out_vector[0] = &mag2_out[0];
-    (void)mag2->work(ddc_noutput_items, ddc_out_const, mag2_out_vector);
-    for (unsigned i = 0; i < ddc_noutput_items; i++) {
-        off_channel_energy += mag2_out[i];
-    }
-    off_channel_energy /= ddc_noutput_items;
+    off_channel_energy = mean_power(ddc_out, ddc_noutput_items);
 
     snr = 10.0 * log10(on_channel_energy / off_channel_energy);
 
@@ -44,10 +44,12 @@ void error_out(const char* s)
 single_multi_sniffer::sptr single_multi_sniffer::make(double sample_rate,
                                                       double center_freq,
                                                       double squelch_threshold,
-                                                      bool tun)
+                                                      bool tun,
+                                                      int queue_size,
+                                                      int queue_age)
 {
-    return gnuradio::get_initial_sptr(
-        new single_multi_sniffer_impl(sample_rate, center_freq, squelch_threshold, tun));
+    return gnuradio::get_initial_sptr(new single_multi_sniffer_impl(
+        sample_rate, center_freq, squelch_threshold, tun, queue_size, queue_age));
 }
 
 /*
@@ -56,7 +58,9 @@ single_multi_sniffer::sptr single_multi_sniffer::make(double sample_rate,
 single_multi_sniffer_impl::single_multi_sniffer_impl(double sample_rate,
                                                      double center_freq,
                                                      double squelch_threshold,
-                                                     bool tun)
+                                                     bool tun,
+                                                     int queue_size,
+                                                     int queue_age)
     : single_block(sample_rate, center_freq, squelch_threshold),
       gr::sync_block("bluetooth multi sniffer block",
                      gr::io_signature::make(1, 1, sizeof(gr_complex)),
@@ -65,6 +69,8 @@ single_multi_sniffer_impl::single_multi_sniffer_impl(double sample_rate,
       d_tunfd(0),
       d_chan_name(),
       d_ether_addr(),
+      d_queue_size(queue_size),
+      d_queue_age((queue_age > 0) ? queue_age : 0),
       d_basic_rate_piconets(),
       d_low_energy_piconets()
 {
@@ -104,9 +110,10 @@ int single_multi_sniffer_impl::work(int noutput_items,
     /* number of symbols available */
     if (brok || leok) {
         int sym_length = history();
-        char* symbols = new char[sym_length];
-        /* pointer to our starting place for sniff_ */
-        char* symp = symbols;
+        symbol_buffer symbols;
+        symbols.reserve(sym_length);
+        /* offset of our starting place for sniff_ */
+        int pos = 0;
         gr_vector_const_void_star cbtch(1);
         cbtch[0] = ch_samples;
         int len = channel_symbols(cbtch, symbols, ch_count);
@@ -121,14 +128,14 @@ int single_multi_sniffer_impl::work(int noutput_items,
             /* look for multiple packets in this slot */
             while (limit >= 0) {
                 /* index to start of packet */
-                int i = classic_packet::sniff_ac(symp, limit);
+                int i = classic_packet::sniff_ac(symbols, pos, limit);
                 if (i >= 0) {
                     int step = i + SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE;
-                    ac(&symp[i], len - i, snr);
+                    ac(symbols, pos + i, len - i, snr);
                     len -= step;
                     if (step >= sym_length)
                         error_out("Bad step");
-                    symp = &symp[step];
+                    pos += step;
                     limit -= step;
                 } else {
                     break;
@@ -137,29 +144,29 @@ int single_multi_sniffer_impl::work(int noutput_items,
         }
 
         if (leok) {
-            symp = symbols;
+            pos = 0;
             int limit = ((len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE) <
                          SYMBOLS_PER_BASIC_RATE_SLOT)
                             ? (len - SYMBOLS_PER_BASIC_RATE_SHORTENED_ACCESS_CODE)
                             : SYMBOLS_PER_BASIC_RATE_SLOT;
 
             while (limit >= 0) {
-                int i = le_packet::sniff_aa(symp, limit, d_center_freq);
+                int i = le_packet::sniff_aa(
+                    symbols, pos, limit, d_center_freq, d_connection_aas);
                 if (i >= 0) {
                     int step = i + SYMBOLS_PER_LOW_ENERGY_PREAMBLE_AA;
-                    // printf("symp[%i], len-i = %i\n", i, len-i);
-                    aa(&symp[i], len - i, snr);
+                    // printf("symbols[%i], len-i = %i\n", pos + i, len-i);
+                    aa(symbols, pos + i, len - i, snr);
                     len -= step;
                     if (step >= sym_length)
                         error_out("Bad step");
-                    symp = &symp[step];
+                    pos += step;
                     limit -= step;
                 } else {
                     break;
                 }
             }
         }
-        delete[] symbols;
     } else {
         delete[] ch_samples;
     }
@@ -177,19 +184,25 @@ int single_multi_sniffer_impl::work(int noutput_items,
 }
 
 /* handle AC */
-void single_multi_sniffer_impl::ac(char* symbols, int len, double snr)
+void single_multi_sniffer_impl::ac(const symbol_buffer& symbols,
+                                   int offset,
+                                   int len,
+                                   double snr)
 {
     /* native (local) clock in 625 us */
     uint32_t clkn = (int)(d_cumulative_count / d_samples_per_slot) & 0x7ffffff;
-    classic_packet::sptr pkt = classic_packet::make(symbols, len, clkn, d_center_freq);
-    uint32_t lap = pkt->get_LAP();
+    classic_packet_view view(symbols, offset, len, d_center_freq);
+    uint32_t lap = view.get_LAP();
 
     printf(
-        "time %6d, snr=%.1f, channel %2d, LAP %06x ", clkn, snr, pkt->get_channel(), lap);
+        "time %6d, snr=%.1f, channel %2d, LAP %06x ", clkn, snr, view.get_channel(), lap);
 
-    if (pkt->header_present()) {
+    /* only copy the symbols out for packets with a header */
+    if (view.header_present()) {
+        classic_packet::sptr pkt = view.make(clkn);
         if (!d_basic_rate_piconets[lap]) {
             d_basic_rate_piconets[lap] = basic_rate_piconet::make(lap);
+            d_basic_rate_piconets[lap]->set_queue_limits(d_queue_size, d_queue_age);
         }
         basic_rate_piconet::sptr pn = d_basic_rate_piconets[lap];
 
@@ -212,22 +225,46 @@ void single_multi_sniffer_impl::ac(char* symbols, int len, double snr)
 }
 
 /* handle AA */
-void single_multi_sniffer_impl::aa(char* symbols, int len, double snr)
+void single_multi_sniffer_impl::aa(const symbol_buffer& symbols,
+                                   int offset,
+                                   int len,
+                                   double snr)
 {
-    le_packet::sptr pkt = le_packet::make(symbols, len, d_center_freq);
+    le_packet::sptr pkt = le_packet::make(symbols, offset, len, d_center_freq);
     uint32_t clkn = (int)(d_cumulative_count / d_samples_per_slot) & 0x7ffffff;
+    uint32_t aa = pkt->get_AA();
+
+    /* data channel CRCs can only be checked once CONNECT_REQ gave CRCInit */
+    if (!pkt->is_advertising()) {
+        std::map<uint32_t, low_energy_piconet::sptr>::iterator it =
+            d_low_energy_piconets.find(aa);
+        if ((it == d_low_energy_piconets.end()) || !it->second->have_crc_init()) {
+            return;
+        }
+        pkt->set_crc_init(it->second->get_crc_init());
+    }
+
+    /* anything failing its CRC is noise, or too damaged to use */
+    pkt->decode();
+    if (!pkt->got_payload()) {
+        return;
+    }
 
     printf("time %6d, snr=%.1f, ", clkn, snr);
     pkt->print();
 
-    if (pkt->header_present()) {
-        uint32_t aa = pkt->get_AA();
+    /* follow the connection a CONNECT_REQ sets up, until it ends */
+    uint32_t crc_init;
+    if (pkt->connect_req(aa, crc_init)) {
         if (!d_low_energy_piconets[aa]) {
             d_low_energy_piconets[aa] = low_energy_piconet::make(aa);
+            d_low_energy_piconets[aa]->set_queue_limits(d_queue_size, d_queue_age);
         }
-        low_energy_piconet::sptr pn = d_low_energy_piconets[aa];
-    } else {
-        // TODO: log AA
+        d_low_energy_piconets[aa]->set_crc_init(crc_init);
+        d_connection_aas.insert(aa);
+    } else if (pkt->terminate_ind()) {
+        d_low_energy_piconets.erase(aa);
+        d_connection_aas.erase(aa);
     }
 }
 
@@ -294,7 +331,7 @@ void single_multi_sniffer_impl::discover(classic_packet::sptr pkt,
     printf("working on UAP/CLK1-6\n");
 
     /* store packet for decoding after discovery is complete */
-    pn->enqueue(pkt);
+    pn->enqueue(pkt, pkt->d_clkn);
 
     if (pn->UAP_from_header(pkt))
         /* success! decode the stored packets */
@@ -310,6 +347,11 @@ void single_multi_sniffer_impl::recall(basic_rate_piconet::sptr pn)
 {
     packet::sptr pkt;
     printf("Decoding queued packets\n");
+    if (pn->queue_overflows() || pn->queue_expired()) {
+        printf("%lu packets dropped from a full queue, %lu too old\n",
+               pn->queue_overflows(),
+               pn->queue_expired());
+    }
 
     while (pkt = pn->dequeue()) {
         classic_packet::sptr cpkt = boost::dynamic_pointer_cast<classic_packet>(pkt);
@@ -359,6 +401,7 @@ void single_multi_sniffer_impl::fhs(classic_packet::sptr pkt)
     /* make use of this information from now on */
     if (!d_basic_rate_piconets[lap]) {
         d_basic_rate_piconets[lap] = basic_rate_piconet::make(lap);
+        d_basic_rate_piconets[lap]->set_queue_limits(d_queue_size, d_queue_age);
     }
     pn = d_basic_rate_piconets[lap];
 
@@ -51,15 +51,22 @@ private:
     unsigned char d_ether_addr[ETH_ALEN];
     static const unsigned short ETHER_TYPE = 0xFFF0;
 
+    /* queue limits handed to each new piconet */
+    int d_queue_size;
+    uint32_t d_queue_age;
+
     /* the piconets we are monitoring */
     std::map<int, basic_rate_piconet::sptr> d_basic_rate_piconets;
     std::map<uint32_t, low_energy_piconet::sptr> d_low_energy_piconets;
 
+    /* AAs of the LE connections seen set up and not yet ended */
+    access_address_set d_connection_aas;
+
     /* handle AC */
-    void ac(char* symbols, int len, double snr);
+    void ac(const symbol_buffer& symbols, int offset, int len, double snr);
 
     /* handle AA */
-    void aa(char* symbols, int len, double snr);
+    void aa(const symbol_buffer& symbols, int offset, int len, double snr);
 
     /* handle ID packet (no header) */
     void id(uint32_t lap);
@@ -83,7 +90,9 @@ public:
     single_multi_sniffer_impl(double sample_rate,
                               double center_freq,
                               double squelch_threshold,
-                              bool tun);
+                              bool tun,
+                              int queue_size,
+                              int queue_age);
     ~single_multi_sniffer_impl();
 
     // Where all the action really happens
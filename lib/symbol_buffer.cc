@@ -0,0 +1,190 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gr_bluetooth/symbol_buffer.h"
+#include <algorithm>
+
+namespace gr {
+  namespace bluetooth {
+
+    /* words holding size symbols, plus the spare zero word */
+    static inline size_t
+    words_for(int size)
+    {
+      return (size + 63) / 64 + 1;
+    }
+
+    symbol_buffer::symbol_buffer()
+      : d_words(1, 0),
+        d_size(0)
+    {
+    }
+
+    symbol_buffer::symbol_buffer(int size)
+      : d_words(words_for(size), 0),
+        d_size(size)
+    {
+    }
+
+    symbol_buffer::symbol_buffer(const char *symbols, int size)
+      : d_words(1, 0),
+        d_size(0)
+    {
+      pack(symbols, size);
+    }
+
+    int
+    symbol_buffer::capacity() const
+    {
+      return (int) (d_words.capacity() - 1) * 64;
+    }
+
+    void
+    symbol_buffer::reserve(int size)
+    {
+      d_words.reserve(words_for(size));
+    }
+
+    void
+    symbol_buffer::resize(int size)
+    {
+      if (size < 0) {
+        size = 0;
+      }
+      d_words.resize(words_for(size), 0);
+      d_size = size;
+      trim();
+    }
+
+    void
+    symbol_buffer::trim()
+    {
+      int used = (d_size + 63) / 64;
+      if (d_size & 63) {
+        d_words[used - 1] &= (UINT64_C(1) << (d_size & 63)) - 1;
+      }
+      std::fill(d_words.begin() + used, d_words.end(), 0);
+    }
+
+    void
+    symbol_buffer::set(int i, int symbol)
+    {
+      uint64_t bit = UINT64_C(1) << (i & 63);
+      if (symbol) {
+        d_words[i >> 6] |= bit;
+      }
+      else {
+        d_words[i >> 6] &= ~bit;
+      }
+    }
+
+    void
+    symbol_buffer::append_bits(uint64_t v, int n)
+    {
+      int word = d_size >> 6;
+      int shift = d_size & 63;
+
+      if (n < 64) {
+        v &= (UINT64_C(1) << n) - 1;
+      }
+      if (d_words.size() < words_for(d_size + n)) {
+        d_words.resize(words_for(d_size + n), 0);
+      }
+      d_words[word] |= v << shift;
+      if (shift && (shift + n > 64)) {
+        d_words[word + 1] |= v >> (64 - shift);
+      }
+      d_size += n;
+    }
+
+    void
+    symbol_buffer::append(const uint64_t *words, int n)
+    {
+      for (int i = 0; i < n; i += 64) {
+        append_bits(words[i / 64], std::min(64, n - i));
+      }
+    }
+
+    void
+    symbol_buffer::append(const symbol_buffer& src, int pos, int n)
+    {
+      for (int i = 0; i < n; i += 64) {
+        append_bits(src.bits(pos + i, std::min(64, n - i)), std::min(64, n - i));
+      }
+    }
+
+    void
+    symbol_buffer::assign(const symbol_buffer& src, int pos, int n)
+    {
+      clear();
+      append(src, pos, n);
+    }
+
+    void
+    symbol_buffer::erase_front(int n)
+    {
+      if (n <= 0) {
+        return;
+      }
+      if (n >= d_size) {
+        clear();
+        return;
+      }
+      int size = d_size - n;
+      int used = (size + 63) / 64;
+      for (int i = 0; i < used; i++) {
+        d_words[i] = bits(n + i * 64, 64);
+      }
+      d_size = size;
+      trim();
+    }
+
+    void
+    symbol_buffer::pack(const char *symbols, int n)
+    {
+      clear();
+      d_words.resize(words_for(n), 0);
+      for (int i = 0; i < n; i++) {
+        if (symbols[i] & 1) {
+          d_words[i >> 6] |= UINT64_C(1) << (i & 63);
+        }
+      }
+      d_size = n;
+    }
+
+    void
+    symbol_buffer::unpack(int pos, int n, char *out) const
+    {
+      for (int i = 0; i < n; i++) {
+        out[i] = (*this)[pos + i];
+      }
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
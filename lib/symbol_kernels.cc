@@ -0,0 +1,290 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "symbol_kernels.h"
+#include <volk/volk.h>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BLUETOOTH_KERNELS_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define BLUETOOTH_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace gr {
+  namespace bluetooth {
+
+    /* products per pass, small enough to keep the temporary on the stack */
+    static const int DEMOD_CHUNK = 512;
+
+    void
+    quadrature_demod(const gr_complex *in, float *out, int n, float gain)
+    {
+      lv_32fc_t product[DEMOD_CHUNK];
+
+      for (int i = 1; i < n; i += DEMOD_CHUNK) {
+        int len = std::min(DEMOD_CHUNK, n - i);
+        volk_32fc_x2_multiply_conjugate_32fc(product, &in[i], &in[i-1], len);
+        /* the kernel divides by its normalize factor */
+        volk_32fc_s32f_atan2_32f(&out[i], product, 1.0f / gain, len);
+      }
+    }
+
+    void
+    binary_slicer_generic(const float *in, char *out, int n)
+    {
+      for (int i = 0; i < n; i++) {
+        out[i] = (in[i] < 0) ? 0 : 1;
+      }
+    }
+
+    /* fill words from symbol 'start' (a multiple of 64) up to n */
+    static void
+    packed_slicer_tail(const float *in, uint64_t *out, int start, int n)
+    {
+      for (int w = start; w < n; w += 64) {
+        int len = std::min(64, n - w);
+        uint64_t word = 0;
+        for (int b = 0; b < len; b++) {
+          if (!(in[w + b] < 0)) {
+            word |= (uint64_t) 1 << b;
+          }
+        }
+        out[w / 64] = word;
+      }
+    }
+
+    void
+    packed_slicer_generic(const float *in, uint64_t *out, int n)
+    {
+      packed_slicer_tail(in, out, 0, n);
+    }
+
+#ifdef BLUETOOTH_KERNELS_X86
+    /*
+     * The compare mask is all ones for negative inputs, so adding one
+     * to the narrowed mask turns it straight into the 0/1 symbol.  NaN
+     * compares false and slices to 1, matching the scalar code.
+     */
+    __attribute__((target("sse2")))
+    static void
+    binary_slicer_sse2(const float *in, char *out, int n)
+    {
+      const __m128 zero = _mm_setzero_ps();
+      const __m128i one = _mm_set1_epi8(1);
+      int i = 0;
+
+      for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(in + i), zero));
+        __m128i b = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(in + i + 4), zero));
+        __m128i c = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(in + i + 8), zero));
+        __m128i d = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(in + i + 12), zero));
+        __m128i mask = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        _mm_storeu_si128((__m128i *) (out + i), _mm_add_epi8(mask, one));
+      }
+      binary_slicer_generic(in + i, out + i, n - i);
+    }
+
+    __attribute__((target("sse2")))
+    static void
+    packed_slicer_sse2(const float *in, uint64_t *out, int n)
+    {
+      const __m128 zero = _mm_setzero_ps();
+      int w = 0;
+
+      for (; w + 64 <= n; w += 64) {
+        uint64_t negative = 0;
+        for (int g = 0; g < 64; g += 4) {
+          negative |= (uint64_t) _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(in + w + g), zero)) << g;
+        }
+        out[w / 64] = ~negative;
+      }
+      packed_slicer_tail(in, out, w, n);
+    }
+
+    __attribute__((target("avx2")))
+    static void
+    binary_slicer_avx2(const float *in, char *out, int n)
+    {
+      const __m256 zero = _mm256_setzero_ps();
+      const __m256i one = _mm256_set1_epi8(1);
+      /* packs works per 128 bit lane, this puts the dwords back in order */
+      const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+      int i = 0;
+
+      for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(in + i), zero, _CMP_LT_OQ));
+        __m256i b = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(in + i + 8), zero, _CMP_LT_OQ));
+        __m256i c = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(in + i + 16), zero, _CMP_LT_OQ));
+        __m256i d = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(in + i + 24), zero, _CMP_LT_OQ));
+        __m256i mask = _mm256_packs_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+        mask = _mm256_permutevar8x32_epi32(mask, order);
+        _mm256_storeu_si256((__m256i *) (out + i), _mm256_add_epi8(mask, one));
+      }
+      binary_slicer_sse2(in + i, out + i, n - i);
+    }
+
+    __attribute__((target("avx2")))
+    static void
+    packed_slicer_avx2(const float *in, uint64_t *out, int n)
+    {
+      const __m256 zero = _mm256_setzero_ps();
+      int w = 0;
+
+      for (; w + 64 <= n; w += 64) {
+        uint64_t negative = 0;
+        for (int g = 0; g < 64; g += 8) {
+          __m256 lt = _mm256_cmp_ps(_mm256_loadu_ps(in + w + g), zero, _CMP_LT_OQ);
+          negative |= (uint64_t) _mm256_movemask_ps(lt) << g;
+        }
+        out[w / 64] = ~negative;
+      }
+      packed_slicer_tail(in, out, w, n);
+    }
+#endif /* BLUETOOTH_KERNELS_X86 */
+
+#ifdef BLUETOOTH_KERNELS_NEON
+    /* 16 symbols as 0/1 bytes, via the narrowed compare mask plus one */
+    static inline uint8x16_t
+    slice16_neon(const float *in)
+    {
+      const float32x4_t zero = vdupq_n_f32(0.0f);
+      uint16x8_t ab = vcombine_u16(vmovn_u32(vcltq_f32(vld1q_f32(in), zero)),
+                                   vmovn_u32(vcltq_f32(vld1q_f32(in + 4), zero)));
+      uint16x8_t cd = vcombine_u16(vmovn_u32(vcltq_f32(vld1q_f32(in + 8), zero)),
+                                   vmovn_u32(vcltq_f32(vld1q_f32(in + 12), zero)));
+      uint8x16_t mask = vcombine_u8(vmovn_u16(ab), vmovn_u16(cd));
+      return vaddq_u8(mask, vdupq_n_u8(1));
+    }
+
+    static void
+    binary_slicer_neon(const float *in, char *out, int n)
+    {
+      int i = 0;
+
+      for (; i + 16 <= n; i += 16) {
+        vst1q_u8((uint8_t *) (out + i), slice16_neon(in + i));
+      }
+      binary_slicer_generic(in + i, out + i, n - i);
+    }
+
+    static void
+    packed_slicer_neon(const float *in, uint64_t *out, int n)
+    {
+      static const int8_t shift_table[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+      const int8x8_t shifts = vld1_s8(shift_table);
+      int w = 0;
+
+      for (; w + 64 <= n; w += 64) {
+        uint64_t word = 0;
+        for (int g = 0; g < 64; g += 16) {
+          uint8x16_t bits = slice16_neon(in + w + g);
+          uint64_t lo = vaddv_u8(vshl_u8(vget_low_u8(bits), shifts));
+          uint64_t hi = vaddv_u8(vshl_u8(vget_high_u8(bits), shifts));
+          word |= (lo | (hi << 8)) << g;
+        }
+        out[w / 64] = word;
+      }
+      packed_slicer_tail(in, out, w, n);
+    }
+#endif /* BLUETOOTH_KERNELS_NEON */
+
+    struct slicer_kernels
+    {
+      const char *name;
+      void (*bytes)(const float *, char *, int);
+      void (*packed)(const float *, uint64_t *, int);
+    };
+
+    /* picked once, on first use */
+    static const slicer_kernels &
+    slicers()
+    {
+      static const slicer_kernels kernels = []() -> slicer_kernels {
+#ifdef BLUETOOTH_KERNELS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+          return slicer_kernels{ "avx2", binary_slicer_avx2, packed_slicer_avx2 };
+        }
+        if (__builtin_cpu_supports("sse2")) {
+          return slicer_kernels{ "sse2", binary_slicer_sse2, packed_slicer_sse2 };
+        }
+#endif
+#ifdef BLUETOOTH_KERNELS_NEON
+        return slicer_kernels{ "neon", binary_slicer_neon, packed_slicer_neon };
+#endif
+        return slicer_kernels{ "generic", binary_slicer_generic, packed_slicer_generic };
+      }();
+      return kernels;
+    }
+
+    void
+    binary_slicer(const float *in, char *out, int n)
+    {
+      slicers().bytes(in, out, n);
+    }
+
+    void
+    packed_slicer(const float *in, uint64_t *out, int n)
+    {
+      slicers().packed(in, out, n);
+    }
+
+    /* symbols sliced per pass when out does not end on a word boundary */
+    static const int SLICER_CHUNK = 1024;
+
+    void
+    append_sliced(const float *in, int n, symbol_buffer& out)
+    {
+      int end = out.size();
+
+      if ((end % symbol_buffer::SYMBOLS_PER_WORD) == 0) {
+        /* slice straight into the buffer's words */
+        out.resize(end + n);
+        packed_slicer(in, out.words() + end / symbol_buffer::SYMBOLS_PER_WORD, n);
+        return;
+      }
+      uint64_t packed[SLICER_CHUNK / 64];
+      for (int i = 0; i < n; i += SLICER_CHUNK) {
+        int len = std::min(SLICER_CHUNK, n - i);
+        packed_slicer(in + i, packed, len);
+        out.append(packed, len);
+      }
+    }
+
+    const char *
+    slicer_implementation()
+    {
+      return slicers().name;
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
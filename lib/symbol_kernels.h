@@ -0,0 +1,66 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_SYMBOL_KERNELS_H
+#define INCLUDED_BLUETOOTH_SYMBOL_KERNELS_H
+
+#include <gnuradio/gr_complex.h>
+#include <gr_bluetooth/symbol_buffer.h>
+#include <stdint.h>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * FM demodulator, out[i] = gain * arg(in[i] * conj(in[i-1])) for
+     * 1 <= i < n.  out[0] is left alone, as in the block methods this
+     * replaces.  The conjugate multiply and atan2 run through VOLK, so
+     * the SIMD variant is picked at runtime by VOLK's own dispatcher.
+     */
+    void quadrature_demod(const gr_complex *in, float *out, int n, float gain);
+
+    /* binary slicer, out[i] = 0 where in[i] < 0 and 1 otherwise */
+    void binary_slicer(const float *in, char *out, int n);
+
+    /*
+     * Same decision as binary_slicer(), packed LSB first: symbol i is
+     * bit i % 64 of out[i / 64].  Unused bits of the last word are 0.
+     */
+    void packed_slicer(const float *in, uint64_t *out, int n);
+
+    /* slice n soft symbols onto the end of out */
+    void append_sliced(const float *in, int n, symbol_buffer& out);
+
+    /* name of the slicer variant picked for this CPU */
+    const char *slicer_implementation();
+
+    /* portable reference versions, also the fallback on other CPUs */
+    void binary_slicer_generic(const float *in, char *out, int n);
+    void packed_slicer_generic(const float *in, uint64_t *out, int n);
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_SYMBOL_KERNELS_H */
@@ -0,0 +1,150 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "worker_pool.h"
+#include <boost/bind.hpp>
+#include <algorithm>
+
+namespace gr {
+  namespace bluetooth {
+
+    worker_pool::worker_pool(int nthreads)
+      : d_task(NULL),
+        d_next(0),
+        d_ntasks(0),
+        d_busy(0),
+        d_generation(0),
+        d_shutdown(false)
+    {
+      for (int i = 1; i < nthreads; i++) {
+        d_threads.push_back(new gr::thread::thread(boost::bind(&worker_pool::run, this)));
+      }
+    }
+
+    worker_pool::~worker_pool()
+    {
+      {
+        gr::thread::scoped_lock lock(d_mutex);
+        d_shutdown = true;
+      }
+      d_work_cond.notify_all();
+      for (unsigned i = 0; i < d_threads.size(); i++) {
+        d_threads[i]->join();
+        delete d_threads[i];
+      }
+    }
+
+    int
+    worker_pool::default_nthreads(int n)
+    {
+      int hw = (int) gr::thread::thread::hardware_concurrency();
+      if (hw < 1) {
+        hw = 1;
+      }
+      return std::max(1, std::min(hw, n));
+    }
+
+    bool
+    worker_pool::next_iteration(int &i)
+    {
+      gr::thread::scoped_lock lock(d_mutex);
+      if (d_next >= d_ntasks) {
+        return false;
+      }
+      i = d_next++;
+      return true;
+    }
+
+    void
+    worker_pool::drain(const task &fn)
+    {
+      int i;
+      while (next_iteration(i)) {
+        fn(i);
+      }
+    }
+
+    void
+    worker_pool::run()
+    {
+      unsigned long seen = 0;
+      for (;;) {
+        const task *fn;
+        {
+          gr::thread::scoped_lock lock(d_mutex);
+          while (!d_shutdown && (d_generation == seen)) {
+            d_work_cond.wait(lock);
+          }
+          if (d_shutdown) {
+            return;
+          }
+          seen = d_generation;
+          fn = d_task;
+        }
+
+        drain(*fn);
+
+        gr::thread::scoped_lock lock(d_mutex);
+        if (--d_busy == 0) {
+          d_done_cond.notify_one();
+        }
+      }
+    }
+
+    void
+    worker_pool::parallel_for(int n, const task &fn)
+    {
+      if (d_threads.empty() || (n <= 1)) {
+        for (int i = 0; i < n; i++) {
+          fn(i);
+        }
+        return;
+      }
+
+      {
+        gr::thread::scoped_lock lock(d_mutex);
+        d_task   = &fn;
+        d_next   = 0;
+        d_ntasks = n;
+        d_busy   = (int) d_threads.size();
+        d_generation++;
+      }
+      d_work_cond.notify_all();
+
+      drain(fn);
+
+      gr::thread::scoped_lock lock(d_mutex);
+      while (d_busy > 0) {
+        d_done_cond.wait(lock);
+      }
+      d_task = NULL;
+    }
+
+  } /* namespace bluetooth */
+} /* namespace gr */
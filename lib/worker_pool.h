@@ -0,0 +1,88 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2013 Christopher D. Kilgour
+ * Copyright 2008, 2009 Dominic Spill, Michael Ossmann
+ * Copyright 2007 Dominic Spill
+ * Copyright 2005, 2006 Free Software Foundation, Inc.
+ *
+ * This file is part of gr-bluetooth
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_BLUETOOTH_WORKER_POOL_H
+#define INCLUDED_BLUETOOTH_WORKER_POOL_H
+
+#include <gnuradio/thread/thread.h>
+#include <boost/function.hpp>
+#include <vector>
+
+namespace gr {
+  namespace bluetooth {
+
+    /*
+     * Fixed set of worker threads that run the iterations of a loop in
+     * parallel.  Iterations are handed out one at a time from a shared
+     * counter, so a worker that finishes a quiet channel early moves on
+     * to the next one.  The calling thread works too, and parallel_for()
+     * only returns once every iteration is done.
+     */
+    class worker_pool
+    {
+    public:
+      typedef boost::function<void (int)> task;
+
+    private:
+      std::vector<gr::thread::thread *> d_threads;
+
+      gr::thread::mutex              d_mutex;
+      gr::thread::condition_variable d_work_cond;
+      gr::thread::condition_variable d_done_cond;
+
+      /* loop being run, next iteration to hand out, and its length */
+      const task *d_task;
+      int         d_next;
+      int         d_ntasks;
+
+      /* workers still busy with the current loop */
+      int         d_busy;
+
+      /* bumped for every loop so workers can tell new work from old */
+      unsigned long d_generation;
+      bool          d_shutdown;
+
+      bool next_iteration(int &i);
+      void drain(const task &fn);
+      void run();
+
+    public:
+      /* nthreads includes the calling thread; 1 or less runs inline */
+      worker_pool(int nthreads);
+      ~worker_pool();
+
+      int nthreads() const { return (int) d_threads.size() + 1; }
+
+      /* call fn(i) for 0 <= i < n */
+      void parallel_for(int n, const task &fn);
+
+      /* a sensible thread count for n independent iterations */
+      static int default_nthreads(int n);
+    };
+
+  } // namespace bluetooth
+} // namespace gr
+
+#endif /* INCLUDED_BLUETOOTH_WORKER_POOL_H */